@@ -1,41 +1,185 @@
 #include "blueprint_database.hpp"
 #include "utilities.hpp"
+#include "yakka_stats.hpp"
 #include "yakka.hpp"
 #include "inja.hpp"
 #include "glob/glob.h"
 #include "spdlog/spdlog.h"
 #include <regex>
+#include <algorithm>
 
 namespace yakka {
-std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(const std::string target, const nlohmann::json &project_summary)
+/**
+ * @brief Splits a '[a, b, c]' dependency list without a YAML parse
+ * @return false if the list contains YAML syntax other than plain comma separated scalars
+ */
+static bool split_plain_list(const std::string &input, std::vector<std::string> &output)
 {
+  const std::string_view content(input.data() + 1, input.size() - 2);
+  if (content.find_first_of("\"'[]{}#&*!|>%@`") != std::string_view::npos || content.find(": ") != std::string_view::npos || content.find(":,") != std::string_view::npos || content.ends_with(':'))
+    return false;
+
+  size_t start = 0;
+  while (start <= content.size()) {
+    size_t end = content.find(',', start);
+    if (end == std::string_view::npos)
+      end = content.size();
+    auto item        = content.substr(start, end - start);
+    const auto first = item.find_first_not_of(" \t\r\n");
+    if (first != std::string_view::npos)
+      output.emplace_back(item.substr(first, item.find_last_not_of(" \t\r\n") - first + 1));
+    start = end + 1;
+  }
+  return true;
+}
+
+/**
+ * @brief Returns the text every string matched by a regex starts with. Empty if the pattern has alternatives or starts with a special character.
+ */
+static std::string literal_prefix(std::string_view pattern)
+{
+  if (pattern.find('|') != std::string_view::npos)
+    return {};
+
+  const auto end = pattern.find_first_of(".[]{}()\\*+?^$");
+  if (end == std::string_view::npos)
+    return std::string(pattern);
+
+  // A quantifier applies to the character before it
+  if (end > 0 && (pattern[end] == '*' || pattern[end] == '?' || pattern[end] == '{'))
+    return std::string(pattern.substr(0, end - 1));
+  return std::string(pattern.substr(0, end));
+}
+
+void blueprint_database::add(const std::string &name, std::shared_ptr<blueprint> b)
+{
+  static auto &regex_compile_stats = get_stat_counter("regex compile");
+  if (b->regex.has_value()) {
+    scoped_stat_timer compile_timer(regex_compile_stats);
+    regex_blueprints.push_back({ name, literal_prefix(name), std::regex{ name }, b });
+  }
+  blueprints.insert({ name, std::move(b) });
+}
+
+/**
+ * @brief Returns the text every rendering of a templated blueprint name starts with.
+ *        Expressions that only name a value that is constant for the run, such as '{{project_output}}', are replaced by the value from the
+ *        summary. The prefix ends at any other template markup.
+ */
+static std::string template_prefix(const std::string &name_template, const nlohmann::json &project_summary)
+{
+  static const std::regex constant_name(R"(\s*((project_name|project_output|configuration)(\.\w+)*)\s*)");
+  std::string prefix;
+  size_t position = 0;
+  while (true) {
+    const auto end = std::min({ name_template.find("{{", position), name_template.find("{%", position), name_template.find("{#", position), name_template.find("##", position) });
+    prefix.append(name_template, position, end - position);
+    if (end == std::string::npos)
+      return prefix;
+
+    // Whitespace control removes the whitespace before the markup
+    if (end + 2 < name_template.size() && name_template[end + 2] == '-')
+      prefix.erase(prefix.find_last_not_of(" \t\r\n") + 1);
+
+    const auto close = name_template.find("}}", end);
+    std::smatch match;
+    if (name_template.compare(end, 2, "{{") != 0 || close == std::string::npos)
+      return prefix;
+    const std::string expression = name_template.substr(end + 2, close - end - 2);
+    if (!std::regex_match(expression, match, constant_name))
+      return prefix;
+
+    const auto pointer = json_pointer(match[1].str());
+    if (!project_summary.contains(pointer) || !project_summary[pointer].is_string())
+      return prefix;
+    prefix += project_summary[pointer].get<std::string>();
+    position = close + 2;
+  }
+}
+
+void blueprint_database::add_template(const std::string &name_template, std::shared_ptr<blueprint> b, const nlohmann::json &project_summary)
+{
+  const auto prefix = template_prefix(name_template, project_summary);
+  template_blueprints.push_back({ name_template, b->regex.has_value() ? literal_prefix(prefix) : prefix, std::move(b) });
+}
+
+/**
+ * @brief Renders the names of the templated blueprints that could match the target and adds them to the database
+ */
+void blueprint_database::render_templates(std::string_view target, const std::function<std::string(const std::string &)> &render)
+{
+  static auto &stats = get_stat_counter("blueprint name render");
+  for (auto i = template_blueprints.begin(); i != template_blueprints.end();) {
+    if (!target.starts_with(i->prefix)) {
+      ++i;
+      continue;
+    }
+
+    scoped_stat_timer timer(stats);
+    const auto name      = render(i->name_template);
+    i->blueprint->target = name;
+    if (i->blueprint->regex.has_value())
+      i->blueprint->regex = name;
+    add(name, std::move(i->blueprint));
+    i = template_blueprints.erase(i);
+  }
+}
+
+std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(const std::string target, const nlohmann::json &project_summary, aggregate_cache &aggregates)
+{
+  static auto &stats               = get_stat_counter("find_match");
+  static auto &regex_match_stats   = get_stat_counter("regex match");
+  scoped_stat_timer timer(stats);
   bool blueprint_match_found = false;
   std::vector<std::shared_ptr<blueprint_match>> result;
 
-  for (const auto &blueprint: blueprints) {
-    auto match = std::make_shared<blueprint_match>();
+  struct candidate {
+    const std::string *name;
+    std::shared_ptr<yakka::blueprint> blueprint;
+    std::vector<std::string> regex_matches;
+  };
+  std::vector<candidate> candidates;
 
-    // Check if rule is a regex, otherwise do a string comparison
-    if (blueprint.second->regex.has_value()) {
-      std::smatch s;
-      if (!std::regex_match(target, s, std::regex{ blueprint.first }))
-        continue;
+  // Literal names are looked up directly
+  for (auto [i, end] = blueprints.equal_range(target); i != end; ++i)
+    if (!i->second->regex.has_value())
+      candidates.push_back({ &i->first, i->second, { target } });
 
-      // arg_count starts at 0 as the first match is the entire string
-      for (auto &regex_match: s)
-        match->regex_matches.push_back(regex_match.str());
-    } else {
-      if (target != blueprint.first)
-        continue;
+  for (const auto &r: regex_blueprints) {
+    if (!target.starts_with(r.prefix))
+      continue;
 
-      match->regex_matches.push_back(target);
+    std::smatch s;
+    bool matched;
+    {
+      scoped_stat_timer match_timer(regex_match_stats);
+      matched = std::regex_match(target, s, r.regex);
     }
+    if (!matched)
+      continue;
+
+    // arg_count starts at 0 as the first match is the entire string
+    candidate c{ &r.name, r.blueprint, {} };
+    for (auto &regex_match: s)
+      c.regex_matches.push_back(regex_match.str());
+    candidates.push_back(std::move(c));
+  }
+
+  // Keep the order of the blueprint names
+  std::stable_sort(candidates.begin(), candidates.end(), [](const candidate &a, const candidate &b) {
+    return *a.name < *b.name;
+  });
+
+  for (auto &candidate: candidates) {
+    auto match = std::make_shared<blueprint_match>();
 
     // Found a match. Create a blueprint match object
     blueprint_match_found = true;
-    match->blueprint      = blueprint.second;
+    match->blueprint      = candidate.blueprint;
+    match->regex_matches  = std::move(candidate.regex_matches);
 
     inja::Environment local_inja_env;
+    std::vector<std::string> *emitted_dependencies = nullptr;
 
     add_common_template_commands(local_inja_env);
 
@@ -50,7 +194,7 @@ std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(con
       return match->blueprint->parent_path;
     });
     local_inja_env.add_callback("render", 1, [&](const inja::Arguments &args) {
-      return local_inja_env.render(args[0]->get<std::string>(), project_summary);
+      return render_template(local_inja_env, args[0]->get<std::string>(), project_summary);
     });
     local_inja_env.add_callback("select", 1, [&](const inja::Arguments &args) {
       nlohmann::json choice;
@@ -65,54 +209,60 @@ std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(con
       return choice;
     });
     local_inja_env.add_callback("aggregate", 1, [&](const inja::Arguments &args) {
-      nlohmann::json aggregate;
-      auto path = json_pointer(args[0]->get<std::string>());
-      // Loop through components, check if object path exists, if so add it to the aggregate
-      for (const auto &[c_key, c_value]: project_summary["components"].items()) {
-        // auto v = json_path(c.value(), path);
-        if (!c_value.contains(path))
-          continue;
-
-        auto v = c_value[path];
-        if (v.is_object())
-          for (const auto &[i_key, i_value]: v.items())
-            aggregate[i_key] = i_value; //local_inja_env.render(i.second.as<std::string>(), this->project_summary);
-        else if (v.is_array())
-          for (const auto &i: v)
-            aggregate.push_back(local_inja_env.render(i.get<std::string>(), project_summary));
-        else
-          aggregate.push_back(local_inja_env.render(v.get<std::string>(), project_summary));
-      }
-
-      // Check project data
-      if (project_summary["data"].contains(path)) {
-        auto v = project_summary["data"][path];
-        if (v.is_object())
-          for (const auto &[i_key, i_value]: v.items())
-            aggregate[i_key] = i_value;
-        else if (v.is_array())
-          for (const auto &i: v)
-            aggregate.push_back(local_inja_env.render(i.get<std::string>(), project_summary));
+      return aggregates.aggregate(project_summary, args[0]->get<std::string>(), [&](const std::string &input) {
+        return render_template(local_inja_env, input, project_summary);
+      });
+    });
+    // Appends dependencies directly while a list dependency is being evaluated. Accepts a single name, an array of names or null.
+    local_inja_env.add_callback("emit", 1, [&](const inja::Arguments &args) {
+      if (emitted_dependencies != nullptr && !args[0]->is_null()) {
+        if (args[0]->is_array())
+          for (const auto &i: *args[0])
+            emitted_dependencies->push_back(i.get<std::string>());
         else
-          aggregate.push_back(local_inja_env.render(v.get<std::string>(), project_summary));
+          emitted_dependencies->push_back(args[0]->get<std::string>());
       }
-      return aggregate;
+      return nlohmann::json("");
     });
 
+    auto add_dependency = [&match](std::string_view d) {
+      match->dependencies.push_back(intern(strip_current_directory(d)));
+    };
+
     // Run template engine on dependencies
-    for (auto d: blueprint.second->dependencies) {
+    for (auto d: candidate.blueprint->dependencies) {
       switch (d.type) {
         case blueprint::dependency::DEPENDENCY_FILE_DEPENDENCY: {
           const std::string generated_dependency_file = yakka::try_render(local_inja_env, d.name, project_summary);
-          auto dependencies                           = parse_gcc_dependency_file(generated_dependency_file);
-          match->dependencies.insert(std::end(match->dependencies), std::begin(dependencies), std::end(dependencies));
+          const auto dependencies                     = parse_gcc_dependency_file(generated_dependency_file);
+          match->dependency_files.push_back(generated_dependency_file);
+          match->dependencies.reserve(match->dependencies.size() + dependencies.size());
+          for (const auto &i: dependencies)
+            match->dependencies.push_back(intern(i));
           continue;
         }
         case blueprint::dependency::DATA_DEPENDENCY: {
           std::string data_name = yakka::try_render(local_inja_env, d.name, project_summary);
           if (data_name.front() != yakka::data_dependency_identifier)
             data_name.insert(0, 1, yakka::data_dependency_identifier);
-          match->dependencies.push_back(data_name);
+          match->dependencies.push_back(intern(data_name));
+          continue;
+        }
+        case blueprint::dependency::LIST_DEPENDENCY: {
+          // The rendered text is discarded, the template adds each element with emit()
+          std::vector<std::string> list;
+          emitted_dependencies = &list;
+          try {
+            render_template(local_inja_env, d.name, project_summary);
+          } catch (std::exception &e) {
+            emitted_dependencies = nullptr;
+            spdlog::error("Error evaluating dependency list for {}\r\nCouldn't apply template: '{}'\n{}", *candidate.name, d.name, e.what());
+            return result;
+          }
+          emitted_dependencies = nullptr;
+          match->dependencies.reserve(match->dependencies.size() + list.size());
+          for (const auto &i: list)
+            add_dependency(i);
           continue;
         }
         default:
@@ -122,26 +272,32 @@ std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(con
       // Generate full dependency string by applying template engine
       std::string generated_depend;
       try {
-        generated_depend = local_inja_env.render(d.name, project_summary);
+        generated_depend = render_template(local_inja_env, d.name, project_summary);
       } catch (std::exception &e) {
-        spdlog::error("Error evaluating dependency for {}\r\nCouldn't apply template: '{}'\n{}", blueprint.first, d.name, e.what());
+        spdlog::error("Error evaluating dependency for {}\r\nCouldn't apply template: '{}'\n{}", *candidate.name, d.name, e.what());
         return result;
       }
 
-      // Check if the input was a YAML array construct
+      // Check if the input was a YAML array construct. Kept for blueprints that don't use the list form.
       if (generated_depend.front() == '[' && generated_depend.back() == ']') {
+        std::vector<std::string> list;
+        if (split_plain_list(generated_depend, list)) {
+          for (const auto &i: list)
+            add_dependency(i);
+          continue;
+        }
+
         // Load the generated dependency string as YAML and push each item individually
         try {
           auto generated_node = YAML::Load(generated_depend);
           for (auto i: generated_node) {
-            auto temp = i.Scalar();
-            match->dependencies.push_back(temp.starts_with("./") ? temp.substr(temp.find_first_not_of("/", 2)) : temp);
+            add_dependency(i.Scalar());
           }
         } catch (std::exception &e) {
           std::cerr << "Failed to parse dependency: " << d.name << "\n";
         }
       } else {
-        match->dependencies.push_back(generated_depend.starts_with("./") ? generated_depend.substr(generated_depend.find_first_not_of("/", 2)) : generated_depend);
+        add_dependency(generated_depend);
       }
     }
 
@@ -150,7 +306,7 @@ std::vector<std::shared_ptr<blueprint_match>> blueprint_database::find_match(con
   }
 
   if (!blueprint_match_found) {
-    if (!fs::exists(target))
+    if (!timed_exists(target))
       spdlog::info("No blueprint for '{}'", target);
   }
   return result;
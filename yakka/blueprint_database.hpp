@@ -1,28 +1,55 @@
 #pragma once
 
 #include "yakka_blueprint.hpp"
+#include "utilities.hpp"
+#include "string_interner.hpp"
 #include <string>
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <regex>
+#include <functional>
 
 namespace yakka {
 struct blueprint_match {
-  std::vector<std::string> dependencies; // Template processed dependencies
+  std::vector<interned_string> dependencies; // Template processed dependencies
   std::shared_ptr<yakka::blueprint> blueprint;
-  std::vector<std::string> regex_matches; // Regex capture groups for a particular regex match
+  std::vector<std::string> regex_matches;    // Regex capture groups for a particular regex match
+  std::vector<std::string> dependency_files; // Generated dependency files that were read to create the dependencies
 };
 
 class blueprint_database {
 public:
   void load(const std::string path);
   void save(const std::string path);
-  std::vector<std::shared_ptr<blueprint_match>> find_match(const std::string target, const nlohmann::json &project_summary);
+  void add(const std::string &name, std::shared_ptr<blueprint> b);
+  void add_template(const std::string &name_template, std::shared_ptr<blueprint> b, const nlohmann::json &project_summary);
+  void render_templates(std::string_view target, const std::function<std::string(const std::string &)> &render);
+  std::vector<std::shared_ptr<blueprint_match>> find_match(const std::string target, const nlohmann::json &project_summary, aggregate_cache &aggregates);
 
   // void generate_task_database(std::vector<std::string> command_list);
   // void process_blueprint_target( const std::string target );
 
   std::multimap<std::string, std::shared_ptr<blueprint>> blueprints;
+
+private:
+  // Regex blueprints are compiled once. Targets that don't start with the literal prefix of the pattern are rejected without running the regex.
+  struct regex_blueprint {
+    std::string name;
+    std::string prefix;
+    std::regex regex;
+    std::shared_ptr<yakka::blueprint> blueprint;
+  };
+  // Blueprints with a templated name are rendered the first time a target starts with the text before the template markup.
+  // Leading run constants such as '{{project_output}}' are part of that text.
+  struct template_blueprint {
+    std::string name_template;
+    std::string prefix;
+    std::shared_ptr<yakka::blueprint> blueprint;
+  };
+  std::vector<regex_blueprint> regex_blueprints;
+  std::vector<template_blueprint> template_blueprints;
 };
 
 class target_database {
@@ -30,6 +57,7 @@ public:
   void load(const fs::path file_path);
   void save(const fs::path file_path);
 
-  std::multimap<std::string, std::shared_ptr<blueprint_match>> targets;
+  std::unordered_multimap<interned_string, std::shared_ptr<blueprint_match>> targets;
+  std::unordered_set<interned_string> leaves; // Targets that did not match a blueprint
 };
 } // namespace yakka
@@ -0,0 +1,56 @@
+// Checks that templated blueprint names are only rendered when a target could match them, including names that start with a run constant
+// such as '{{project_output}}'.
+// Usage: blueprint_template_test. Prints the checks as JSON and returns non-zero if any fail.
+#include "blueprint_database.hpp"
+#include "nlohmann/json.hpp"
+#include <iostream>
+#include <map>
+#include <string>
+
+int main(int argc, char **argv)
+{
+  const nlohmann::json summary = {
+    { "project_name", "app-gcc" },
+    { "project_output", "output/app-gcc" },
+    { "configuration", { { "executable_extension", ".exe" } } },
+    { "components", nlohmann::json::object() },
+  };
+  const std::map<std::string, std::string> names = {
+    { "reached", "{{project_output}}/{{project_name}}{{configuration.executable_extension}}" },
+    { "unreached", "{{project_output}}/{{project_name}}.global_ld_options" },
+    { "unreached_spaced", "{{ project_output }}/generated/{{project_name}}.h" },
+    { "unreached_regex", "{{project_output}}/components/(.+)\\.o" },
+    { "not_constant", "{{components}}/unknown" },
+  };
+
+  yakka::blueprint_database database;
+  for (const auto &[id, name]: names) {
+    nlohmann::json node = nlohmann::json::object();
+    if (id == "unreached_regex")
+      node["regex"] = name;
+    database.add_template(name, std::make_shared<yakka::blueprint>(name, node, "."), summary);
+  }
+
+  std::map<std::string, int> render_count;
+  auto render = [&](const std::string &name) {
+    for (const auto &[id, n]: names)
+      if (n == name)
+        ++render_count[id];
+    return std::string{ "rendered/" } + name;
+  };
+  database.render_templates("output/app-gcc/app-gcc.exe", render);
+  database.render_templates("output/app-gcc/app-gcc.exe", render);
+  database.render_templates("output/other/app-gcc.global_ld_options", render);
+
+  nlohmann::json results                             = nlohmann::json::object();
+  results["reached name rendered once"]              = render_count["reached"] == 1;
+  results["unreached names not rendered"]            = render_count["unreached"] == 0 && render_count["unreached_spaced"] == 0 && render_count["unreached_regex"] == 0;
+  results["names that aren't constant are rendered"] = render_count["not_constant"] == 1;
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  return passed ? 0 : 1;
+}
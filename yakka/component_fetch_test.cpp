@@ -0,0 +1,93 @@
+// Checks that fetching a component fetches everything it requires from a registry once each and then completes the build.
+// 'a' requires 'b' and 'c', and 'b' requires 'd'. Each component is a local bare repository.
+// Usage: component_fetch_test <yakka executable>. Generates a workspace in a temporary directory, prints the checks as JSON and returns non-zero if any fail.
+#include "yakka.hpp"
+#include "utilities.hpp"
+#include "spdlog/spdlog.h"
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static const std::pair<const char *, const char *> test_components[] = {
+  { "a", "name: a\nrequires:\n  components:\n    - b\n    - c\nblueprints:\n  done:\n    process:\n      - echo: complete\n" },
+  { "b", "name: b\nrequires:\n  components:\n    - d\n" },
+  { "c", "name: c\n" },
+  { "d", "name: d\n" },
+};
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+static std::string read_file(const fs::path &path)
+{
+  std::ifstream file(path, std::ios_base::binary);
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+static int git(const fs::path &directory, const std::string &arguments)
+{
+  return yakka::exec("git", "-C \"" + directory.string() + "\" " + arguments).second;
+}
+
+int main(int argc, char **argv)
+{
+  spdlog::set_level(spdlog::level::off);
+  if (argc < 2) {
+    std::cerr << "Usage: component_fetch_test <yakka executable>\n";
+    return 1;
+  }
+
+  const auto yakka_executable   = fs::absolute(argv[1]);
+  const auto root               = fs::temp_directory_path() / "yakka_component_fetch_test";
+  const auto workspace          = root / "workspace";
+  const auto original_directory = fs::current_path();
+  fs::remove_all(root);
+
+  std::string registry = "provides:\n  components:\n";
+  for (const auto &[name, content]: test_components) {
+    const auto source = root / "source" / name;
+    write_file(source / (std::string(name) + ".yakka"), content);
+    git(source, "init -q");
+    git(source, "add .");
+    git(source, "-c user.name=test -c user.email=test@example.com commit -q -m initial");
+    git(source, "branch -M main");
+    git(root, "clone -q --bare \"" + source.string() + "\" " + name + ".git");
+    registry += std::string("    ") + name + ":\n      packages:\n        default:\n          url: " + (root / (std::string(name) + ".git")).generic_string() + "\n          branch: main\n";
+  }
+  write_file(workspace / ".yakka" / "registries" / "test.yaml", registry);
+
+  // The shared home holds the git cache so it is kept inside the test directory
+  fs::current_path(workspace);
+  const auto [output, result] = yakka::exec("HOME=\"" + (root / "home").string() + "\" \"" + yakka_executable.string() + "\"", "done! a -f");
+  const auto log              = read_file(workspace / "yakka.log");
+  fs::current_path(original_directory);
+
+  nlohmann::json results   = nlohmann::json::object();
+  results["run completed"] = result == 0;
+  for (const auto &[name, content]: test_components) {
+    const std::regex fetch_line{ std::string(name) + ": (cloned|fetched) in" };
+    const auto fetches                           = std::distance(std::sregex_iterator(log.begin(), log.end(), fetch_line), std::sregex_iterator());
+    results[std::string(name) + " fetched once"] = fetches == 1 && fs::exists(workspace / "components" / name / (std::string(name) + ".yakka"));
+  }
+
+  fs::remove_all(root);
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  if (!passed)
+    std::cout << output << "\n";
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+#include "copy_engine.hpp"
+#include "file_cache.hpp"
+#include "yakka_stats.hpp"
+#include "taskflow.hpp"
+#include "algorithm/for_each.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace yakka {
+// Plans with fewer files than this are copied on the calling thread
+static const size_t parallel_copy_threshold = 16;
+
+/**
+ * @brief Returns the pool used for parallel copies.
+ *        Copy steps run on the workers of the build so they share one pool rather than each starting their own threads.
+ */
+static tf::Executor &copy_executor()
+{
+  static tf::Executor executor(std::max(1u, std::thread::hardware_concurrency()));
+  return executor;
+}
+
+/**
+ * @brief Returns true if the destination already holds the same content as the source.
+ *        The contents are compared directly which reads the same data as hashing both files but stops at the first difference.
+ */
+static bool is_identical(const fs::path &source, const fs::path &destination, uintmax_t size)
+{
+  std::error_code ec;
+  if (!fs::is_regular_file(destination, ec) || fs::file_size(destination, ec) != size || ec)
+    return false;
+
+  std::ifstream source_file(source, std::ios_base::binary);
+  std::ifstream destination_file(destination, std::ios_base::binary);
+  std::array<char, 64 * 1024> source_buffer;
+  std::array<char, 64 * 1024> destination_buffer;
+  while (source_file && destination_file) {
+    source_file.read(source_buffer.data(), source_buffer.size());
+    destination_file.read(destination_buffer.data(), destination_buffer.size());
+    if (source_file.gcount() != destination_file.gcount() || std::memcmp(source_buffer.data(), destination_buffer.data(), source_file.gcount()) != 0)
+      return false;
+  }
+  return source_file.eof() && destination_file.eof();
+}
+
+/**
+ * @brief Copies the content of a file. On Linux a reflink is tried first, then copy_file_range, so the data doesn't pass through user space.
+ *        Anything else falls back to std::filesystem::copy_file.
+ */
+static void copy_contents(const fs::path &source, const fs::path &destination, uintmax_t size)
+{
+#if defined(__linux__)
+  const int input = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+  if (input >= 0) {
+    struct stat input_stat;
+    const int output = ::fstat(input, &input_stat) == 0 ? ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, input_stat.st_mode & 07777) : -1;
+    bool copied      = false;
+    if (output >= 0) {
+      ::fchmod(output, input_stat.st_mode & 07777);
+      copied = ::ioctl(output, FICLONE, input) == 0;
+      for (uintmax_t remaining = size; !copied;) {
+        if (remaining == 0) {
+          copied = true;
+          break;
+        }
+        const ssize_t count = ::copy_file_range(input, nullptr, output, nullptr, remaining, 0);
+        if (count <= 0)
+          break;
+        remaining -= count;
+      }
+      ::close(output);
+    }
+    ::close(input);
+    if (copied)
+      return;
+  }
+#endif
+  fs::copy_file(source, destination, fs::copy_options::overwrite_existing);
+}
+
+bool copy_engine::is_directory(const fs::path &path) const
+{
+  return directories.contains(path) || fs::is_directory(path);
+}
+
+void copy_engine::add(const fs::path &source, const fs::path &destination, bool recursive)
+{
+  const auto source_status = fs::status(source);
+  if (!fs::exists(source_status))
+    throw fs::filesystem_error("Cannot copy", source, destination, std::make_error_code(std::errc::no_such_file_or_directory));
+
+  if (fs::is_regular_file(source_status)) {
+    const auto target = is_directory(destination) ? destination / source.filename() : destination;
+    files.push_back({ source, target, fs::file_size(source) });
+    return;
+  }
+
+  if (!fs::is_directory(source_status) || !recursive)
+    return;
+
+  directories.insert(destination);
+  for (const auto &entry: fs::recursive_directory_iterator(source)) {
+    const auto target = destination / entry.path().lexically_relative(source);
+    if (entry.is_directory())
+      directories.insert(target);
+    else if (entry.is_regular_file())
+      files.push_back({ entry.path(), target, entry.file_size() });
+  }
+}
+
+copy_engine::summary copy_engine::run()
+{
+  static auto &bytes_copied = get_stat_counter("bytes copied");
+  summary result;
+  std::mutex result_mutex;
+
+  // When several copies write the same destination the last one planned wins, as it would if they ran in order
+  std::set<fs::path> planned_destinations;
+  std::vector<file_copy> unique_files;
+  for (auto f = files.rbegin(); f != files.rend(); ++f)
+    if (planned_destinations.insert(f->destination).second)
+      unique_files.push_back(std::move(*f));
+  std::reverse(unique_files.begin(), unique_files.end());
+  files = std::move(unique_files);
+
+  // Create every destination directory up front so the copies don't race on them
+  for (const auto &f: files)
+    directories.insert(f.destination.parent_path());
+  for (const auto &d: directories)
+    if (!d.empty())
+      fs::create_directories(d);
+
+  auto copy_file = [&](size_t i) {
+    const auto &f = files[i];
+    try {
+      if (is_identical(f.source, f.destination, f.size)) {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        ++result.skipped_files;
+        return;
+      }
+      copy_contents(f.source, f.destination, f.size);
+      get_file_cache().invalidate(f.destination);
+      bytes_copied.add_amount(f.size);
+      std::lock_guard<std::mutex> lock(result_mutex);
+      ++result.copied_files;
+      result.copied_bytes += f.size;
+    } catch (std::exception &e) {
+      std::lock_guard<std::mutex> lock(result_mutex);
+      result.errors.push_back(e.what());
+    }
+  };
+
+  if (files.size() < parallel_copy_threshold) {
+    for (size_t i = 0; i < files.size(); ++i)
+      copy_file(i);
+  } else {
+    tf::Taskflow taskflow;
+    taskflow.for_each_index(size_t{ 0 }, files.size(), size_t{ 1 }, copy_file);
+    copy_executor().run(taskflow).wait();
+  }
+
+  files.clear();
+  directories.clear();
+  return result;
+}
+} // namespace yakka
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yakka {
+/**
+ * @brief Copies files for the 'copy' built-in.
+ *        All copies are planned first, with directories expanded into their files, and then run in parallel.
+ *        A destination that already holds the same content as its source is skipped so it isn't dirtied.
+ */
+class copy_engine {
+public:
+  struct summary {
+    size_t copied_files    = 0;
+    uintmax_t copied_bytes = 0;
+    size_t skipped_files   = 0;
+    std::vector<std::string> errors;
+  };
+
+  // Plans a copy with the same destination rules as std::filesystem::copy. Directories are only copied if recursive is set.
+  void add(const std::filesystem::path &source, const std::filesystem::path &destination, bool recursive);
+
+  // Runs every planned copy and clears the plan
+  summary run();
+
+private:
+  struct file_copy {
+    std::filesystem::path source;
+    std::filesystem::path destination;
+    uintmax_t size;
+  };
+
+  bool is_directory(const std::filesystem::path &path) const;
+
+  std::vector<file_copy> files;
+  std::set<std::filesystem::path> directories;
+};
+} // namespace yakka
@@ -0,0 +1,172 @@
+#include "file_cache.hpp"
+#include "yakka_stats.hpp"
+#include "yaml-cpp/yaml.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace yakka {
+// Files at least this large are memory mapped rather than read
+static const size_t mmap_threshold = 64 * 1024;
+
+file_contents::file_contents(const fs::path &path, bool allow_mapping)
+{
+#if defined(__linux__) || defined(__APPLE__)
+  const int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0)
+    throw fs::filesystem_error("Cannot read file", path, std::error_code(errno, std::generic_category()));
+  struct stat file_stat;
+  if (allow_mapping && ::fstat(file, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && static_cast<size_t>(file_stat.st_size) >= mmap_threshold) {
+    void *address = ::mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (address != MAP_FAILED) {
+      mapping = address;
+      data    = static_cast<const char *>(address);
+      size    = file_stat.st_size;
+    }
+  }
+  ::close(file);
+  if (mapping != nullptr)
+    return;
+#endif
+  std::ifstream file_stream(path, std::ios_base::binary);
+  if (!file_stream)
+    throw fs::filesystem_error("Cannot read file", path, std::make_error_code(std::errc::no_such_file_or_directory));
+  buffer.assign(std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>());
+  data = buffer.data();
+  size = buffer.size();
+}
+
+file_contents::~file_contents()
+{
+#if defined(__linux__) || defined(__APPLE__)
+  if (mapping != nullptr)
+    ::munmap(mapping, size);
+#endif
+}
+
+/**
+ * @brief Returns the cached value held in 'member' for a path if the file hasn't changed since it was loaded, otherwise calls load and caches the result.
+ *        Files that can't be stat'ed are not cached.
+ */
+template<typename T, typename Load> std::shared_ptr<const T> file_cache::lookup(const fs::path &path, std::shared_ptr<const T> entry::*member, Load load)
+{
+  std::error_code timestamp_error;
+  std::error_code size_error;
+  const auto timestamp = fs::last_write_time(path, timestamp_error);
+  const auto size      = fs::file_size(path, size_error);
+  if (timestamp_error || size_error)
+    return load();
+
+  const auto key = path.lexically_normal().generic_string();
+  {
+    std::shared_lock guard(lock);
+    auto existing = entries.find(key);
+    if (existing != entries.end() && existing->second.timestamp == timestamp && existing->second.size == size && existing->second.*member)
+      return existing->second.*member;
+  }
+
+  auto value = load();
+
+  // Another worker may have loaded the same file in the meantime. Either copy is valid.
+  std::unique_lock guard(lock);
+  auto &cached = entries[key];
+  if (cached.timestamp != timestamp || cached.size != size)
+    cached = { timestamp, size };
+  cached.*member = value;
+  return value;
+}
+
+std::shared_ptr<const file_contents> file_cache::read(const fs::path &path)
+{
+  return lookup(path, &entry::contents, [&]() {
+    static auto &bytes_read = get_stat_counter("bytes read");
+    static auto &stats      = get_stat_counter("file cache read");
+    scoped_stat_timer timer(stats);
+    auto contents = std::make_shared<const file_contents>(path, can_map(path));
+    bytes_read.add_amount(contents->view().size());
+    return contents;
+  });
+}
+
+std::shared_ptr<const nlohmann::json> file_cache::load_yaml(const fs::path &path)
+{
+  return lookup(path, &entry::yaml, [&]() {
+    static auto &stats = get_stat_counter("file cache load_yaml");
+    scoped_stat_timer timer(stats);
+    if (!fs::exists(path))
+      return std::make_shared<const nlohmann::json>();
+    return std::make_shared<const nlohmann::json>(YAML::LoadFile(path.string()).as<nlohmann::json>());
+  });
+}
+
+std::shared_ptr<const nlohmann::json> file_cache::load_json(const fs::path &path)
+{
+  return lookup(path, &entry::json, [&]() {
+    static auto &stats  = get_stat_counter("file cache load_json");
+    const auto contents = read(path);
+    scoped_stat_timer timer(stats);
+    const auto text = contents->view();
+    return std::make_shared<const nlohmann::json>(nlohmann::json::parse(text.begin(), text.end()));
+  });
+}
+
+void file_cache::invalidate(const fs::path &path)
+{
+  std::error_code error;
+  auto absolute_path = fs::absolute(path, error).lexically_normal().generic_string();
+  std::unique_lock guard(lock);
+  entries.erase(path.lexically_normal().generic_string());
+  written_files.insert(std::move(absolute_path));
+}
+
+void file_cache::clear()
+{
+  std::unique_lock guard(lock);
+  entries.clear();
+}
+
+void file_cache::add_output_directory(const fs::path &directory)
+{
+  std::error_code error;
+  auto absolute_directory = (fs::absolute(directory, error) / "").lexically_normal().generic_string();
+  std::unique_lock guard(lock);
+  if (std::find(output_directories.begin(), output_directories.end(), absolute_directory) == output_directories.end())
+    output_directories.push_back(std::move(absolute_directory));
+}
+
+void file_cache::disable_mapping()
+{
+  std::unique_lock guard(lock);
+  mapping_enabled = false;
+}
+
+/**
+ * @brief Returns whether a file can be memory mapped. Files in an output directory and files the run has written are not.
+ */
+bool file_cache::can_map(const fs::path &path)
+{
+  std::error_code error;
+  const auto absolute_path = fs::absolute(path, error).lexically_normal().generic_string();
+  std::shared_lock guard(lock);
+  if (!mapping_enabled || written_files.contains(absolute_path))
+    return false;
+  return std::none_of(output_directories.begin(), output_directories.end(), [&](const std::string &d) {
+    return absolute_path.starts_with(d);
+  });
+}
+
+file_cache &get_file_cache()
+{
+  static file_cache cache;
+  return cache;
+}
+} // namespace yakka
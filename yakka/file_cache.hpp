@@ -0,0 +1,86 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace yakka {
+/**
+ * @brief Contents of a file read by the file cache. If allowed, large files are memory mapped where the platform supports it.
+ */
+class file_contents {
+public:
+  file_contents(const std::filesystem::path &path, bool allow_mapping);
+  ~file_contents();
+  file_contents(const file_contents &)            = delete;
+  file_contents &operator=(const file_contents &) = delete;
+
+  std::string_view view() const
+  {
+    return { data, size };
+  }
+
+private:
+  std::string buffer;
+  const char *data = nullptr;
+  size_t size      = 0;
+  void *mapping    = nullptr;
+};
+
+/**
+ * @brief Run-wide cache of file contents and the JSON parsed from YAML and JSON files, keyed by path and modification time.
+ *        Templates that run once per source or instance share a single read and parse of each file.
+ *        Entries are shared and immutable. Anything that writes a file during the run must invalidate it.
+ *        A mapped file that is truncated faults its readers, so files the run may write are read rather than mapped. These are the files
+ *        in an output directory and any file that has been invalidated.
+ */
+class file_cache {
+public:
+  // Returns the contents of a file. Throws if the file can't be read.
+  std::shared_ptr<const file_contents> read(const std::filesystem::path &path);
+
+  // Returns a YAML file as JSON, or null if the file doesn't exist
+  std::shared_ptr<const nlohmann::json> load_yaml(const std::filesystem::path &path);
+
+  // Returns a parsed JSON file. Throws if the file can't be read or parsed.
+  std::shared_ptr<const nlohmann::json> load_json(const std::filesystem::path &path);
+
+  void invalidate(const std::filesystem::path &path);
+  void clear();
+
+  // Files in an output directory are never mapped
+  void add_output_directory(const std::filesystem::path &directory);
+
+  // Stops mapping files, for long running processes where any file may be changed while it is held
+  void disable_mapping();
+
+private:
+  struct entry {
+    std::filesystem::file_time_type timestamp;
+    uintmax_t size;
+    std::shared_ptr<const file_contents> contents;
+    std::shared_ptr<const nlohmann::json> yaml;
+    std::shared_ptr<const nlohmann::json> json;
+  };
+
+  template<typename T, typename Load> std::shared_ptr<const T> lookup(const std::filesystem::path &path, std::shared_ptr<const T> entry::*member, Load load);
+  bool can_map(const std::filesystem::path &path);
+
+  std::shared_mutex lock;
+  std::unordered_map<std::string, entry> entries;
+  std::vector<std::string> output_directories;   // Absolute, ending with '/'
+  std::unordered_set<std::string> written_files; // Absolute
+  bool mapping_enabled = true;
+};
+
+// Returns the cache shared by everything in this run
+file_cache &get_file_cache();
+} // namespace yakka
@@ -0,0 +1,94 @@
+// Checks fetching a component from a local bare repository through the git cache, first restricted to a subdirectory and then in full.
+// Usage: git_fetch_test. Generates the repositories in a temporary directory, prints the checks as JSON and returns non-zero if any fail.
+#include "yakka.hpp"
+#include "yakka_workspace.hpp"
+#include "utilities.hpp"
+#include "spdlog/spdlog.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+static std::string git(const fs::path &directory, const std::string &arguments)
+{
+  auto [output, result] = yakka::exec("git", "-C \"" + directory.string() + "\" " + arguments);
+  return result == 0 ? output : "<failed>";
+}
+
+static std::string read_file(const fs::path &path)
+{
+  std::ifstream file(path, std::ios_base::binary);
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+int main(int argc, char **argv)
+{
+  spdlog::set_level(spdlog::level::off);
+
+  const auto root               = fs::temp_directory_path() / "yakka_git_fetch_test";
+  const auto original_directory = fs::current_path();
+  fs::remove_all(root);
+  write_file(root / "source" / "sub" / "a.txt", "a\n");
+  write_file(root / "source" / "other" / "b.txt", "b\n");
+  git(root / "source", "init -q");
+  git(root / "source", "add .");
+  git(root / "source", "-c user.name=test -c user.email=test@example.com commit -q -m initial");
+  git(root / "source", "branch -M main");
+  git(root, "clone -q --bare source remote.git");
+
+  // The fetch logs are written to the current directory
+  fs::current_path(root);
+
+  const auto url         = (root / "remote.git").generic_string();
+  const auto repos       = root / "repos";
+  const auto checkout    = root / "components" / "comp";
+  const auto git_dir     = repos / "comp" / ".git";
+  const auto no_progress = [](std::string, size_t) {};
+  nlohmann::json results = nlohmann::json::object();
+
+  yakka::workspace::fetch_options options;
+  options.cache_location = root / "git-cache";
+  options.sparse_path    = "sub";
+  const auto sparse_path = yakka::workspace::do_fetch_component("comp", url, "main", repos, checkout, options, no_progress);
+
+  // The clone lists the mirror's objects directory as an alternate
+  const auto alternates                = read_file(git_dir / "objects" / "info" / "alternates");
+  const auto mirror                    = fs::path(alternates.substr(0, alternates.find('\n'))).parent_path();
+  results["sparse fetch succeeded"]    = sparse_path == checkout;
+  results["sparse fetch has subdir"]   = fs::exists(checkout / "sub" / "a.txt");
+  results["sparse fetch skips others"] = !fs::exists(checkout / "other" / "b.txt");
+  results["clone borrows from cache"]  = mirror.generic_string().starts_with((root / "git-cache").generic_string());
+  results["cache is never collected"]  = !alternates.empty() && git(mirror, "config gc.auto").starts_with("0");
+
+  // Fetching again without a subdirectory checks out the whole repository
+  options.sparse_path  = "";
+  const auto full_path = yakka::workspace::do_fetch_component("comp", url, "main", repos, checkout, options, no_progress);
+
+  results["full fetch succeeded"]             = full_path == checkout;
+  results["full fetch has subdir"]            = fs::exists(checkout / "sub" / "a.txt");
+  results["full fetch has others"]            = fs::exists(checkout / "other" / "b.txt");
+  results["sparse checkout disabled"]         = git(repos / "comp", "config core.sparseCheckout").starts_with("false");
+  results["sparse checkout patterns removed"] = !fs::exists(git_dir / "info" / "sparse-checkout");
+
+  spdlog::shutdown();
+  fs::current_path(original_directory);
+  fs::remove_all(root);
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// Checks that the 'jinja' built-in renders Jinja templates in the style of the Gecko SDK byte for byte as Jinja does, and that syntax it doesn't
+// support fails the command rather than rendering different output. The expected output was rendered by Jinja2 3.1 with its default settings.
+// Usage: jinja_builtin_test. Writes the templates to a temporary directory, prints the checks as JSON and returns non-zero if any fail.
+#include "yakka.hpp"
+#include "yakka_workspace.hpp"
+#include "yakka_project.hpp"
+#include "utilities.hpp"
+#include "spdlog/spdlog.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static const char *event_handler_template = R"jinja(/***************************************************************************//**
+ * @file sl_event_handler.c
+ ******************************************************************************/
+{# Generated from the event_handler contributions #}
+#include "sl_event_handler.h"
+
+{% for include in event_handler_include -%}
+#include "{{ include.header }}"
+{% endfor %}
+{%- set events = ["platform_init", "driver_init", "service_init"] %}
+{% for event in events %}
+void sl_{{ event }}(void)
+{
+{%- for handler in event_handler %}
+{%- if handler.event == event %}
+  {{ handler.handler }}();
+{%- endif %}
+{%- endfor %}
+}
+{% endfor %}
+{% if power_manager_enabled %}
+#define SL_POWER_MANAGER 1
+{% else %}
+#define SL_POWER_MANAGER 0
+{% endif %}
+)jinja";
+
+static const char *event_handler_expected = R"jinja(/***************************************************************************//**
+ * @file sl_event_handler.c
+ ******************************************************************************/
+
+#include "sl_event_handler.h"
+
+#include "sl_board_init.h"
+#include "sl_device_init_clocks.h"
+
+
+void sl_platform_init(void)
+{
+  sl_board_init();
+  sl_device_init_clocks();
+}
+
+void sl_driver_init(void)
+{
+}
+
+void sl_service_init(void)
+{
+  sl_sleeptimer_init();
+}
+
+
+#define SL_POWER_MANAGER 0
+)jinja";
+
+// Written with CRLF line endings, which Jinja renders as LF
+static const char *catalog_template = R"jinja(#ifndef SL_COMPONENT_CATALOG_H
+#define SL_COMPONENT_CATALOG_H
+
+{#- Features provided by the project -#}
+// APIs present in project
+{% for api in catalog -%}
+#define SL_CATALOG_{{ api.name }}_PRESENT{% if not loop.last %} // {{ loop.index }}{% if loop.first %} first{% endif %}{% endif %}
+{% endfor -%}
+
+static const char *handlers[] = {
+{%- for h in handlers %}
+  "{{ h -}}  "{% if not loop.last %},{% endif %}
+{%- endfor %}
+};
+{% if mode == "fast" %}#define MODE 2{% elif mode == "slow" %}#define MODE 1{% else %}#define MODE 0{% endif %}
+
+#endif // SL_COMPONENT_CATALOG_H
+)jinja";
+
+static const char *catalog_expected = R"jinja(#ifndef SL_COMPONENT_CATALOG_H
+#define SL_COMPONENT_CATALOG_H// APIs present in project
+#define SL_CATALOG_BOARD_PRESENT // 1 first
+#define SL_CATALOG_SLEEPTIMER_PRESENT // 2
+#define SL_CATALOG_POWER_MANAGER_PRESENT
+static const char *handlers[] = {
+  "init",
+  "process",
+  "sleep"
+};
+#define MODE 1
+
+#endif // SL_COMPONENT_CATALOG_H)jinja";
+
+static const char *contributions = R"({
+  "event_handler_include": [ { "header": "sl_board_init.h" }, { "header": "sl_device_init_clocks.h" } ],
+  "event_handler": [
+    { "event": "platform_init", "handler": "sl_board_init" },
+    { "event": "platform_init", "handler": "sl_device_init_clocks" },
+    { "event": "service_init", "handler": "sl_sleeptimer_init" }
+  ],
+  "power_manager_enabled": false,
+  "catalog": [ { "name": "BOARD" }, { "name": "SLEEPTIMER" }, { "name": "POWER_MANAGER" } ],
+  "handlers": [ "init", "process", "sleep" ],
+  "mode": "slow"
+})";
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+static std::string crlf(const std::string &text)
+{
+  std::string output;
+  for (const auto c: text) {
+    if (c == '\n')
+      output += '\r';
+    output += c;
+  }
+  return output;
+}
+
+int main(int argc, char **argv)
+{
+  spdlog::set_level(spdlog::level::off);
+
+  const auto root               = fs::temp_directory_path() / "yakka_jinja_builtin_test";
+  const auto original_directory = fs::current_path();
+  fs::remove_all(root);
+  write_file(root / "templates" / "sl_event_handler.c.jinja", event_handler_template);
+  write_file(root / "templates" / "sl_component_catalog.h.jinja", crlf(catalog_template));
+  write_file(root / "templates" / "filter.jinja", "{{ mode | upper }}\n");
+  write_file(root / "templates" / "macro.jinja", "{% macro define(name) %}#define {{ name }}{% endmacro %}{{ define(mode) }}\n");
+  write_file(root / "templates" / "undefined.jinja", "{{ missing }}\n");
+  write_file(root / "templates" / "undefined_condition.jinja", "{% if missing %}missing{% endif %}\n");
+  write_file(root / "template_contributions.json", contributions);
+  fs::current_path(root);
+
+  nlohmann::json results = nlohmann::json::object();
+  {
+    yakka::workspace workspace;
+    workspace.init(".");
+
+    yakka::project project("test", workspace);
+    project.load_common_commands();
+    inja::Environment inja_env;
+    yakka::add_common_template_commands(inja_env);
+
+    auto render = [&](const nlohmann::json &command) {
+      return project.blueprint_commands.at("jinja")("generated", command, yakka::process_data{}, project.project_summary, inja_env);
+    };
+    auto file_command = [](const std::string &name) {
+      return nlohmann::json{ { "template_file", "templates/" + name }, { "data_file", "template_contributions.json" } };
+    };
+
+    const auto event_handler = render(file_command("sl_event_handler.c.jinja"));
+    const auto catalog       = render(file_command("sl_component_catalog.h.jinja"));
+    const auto tool_style    = render("-t templates/sl_event_handler.c.jinja -d template_contributions.json");
+    const auto undefined     = render(file_command("undefined.jinja"));
+    const auto condition     = render(file_command("undefined_condition.jinja"));
+
+    results["event handler matches Jinja"]       = event_handler.retcode == 0 && event_handler.result == event_handler_expected;
+    results["component catalog matches Jinja"]   = catalog.retcode == 0 && catalog.result == catalog_expected;
+    results["jinja tool arguments are accepted"] = tool_style.retcode == 0 && tool_style.result == event_handler_expected;
+    results["undefined variables are empty"]     = undefined.retcode == 0 && undefined.result.empty();
+    results["undefined conditions are false"]    = condition.retcode == 0 && condition.result.empty();
+    results["filters fail"]                      = render(file_command("filter.jinja")).retcode < 0;
+    results["macros fail"]                       = render(file_command("macro.jinja")).retcode < 0;
+  }
+
+  fs::current_path(original_directory);
+  fs::remove_all(root);
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  return passed ? 0 : 1;
+}
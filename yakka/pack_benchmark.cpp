@@ -0,0 +1,124 @@
+// Compares the compiled 'pack' format against the original element by element implementation.
+// Usage: pack_benchmark [value count]. Prints the timings as JSON.
+#include "pack_format.hpp"
+#include "utilities.hpp"
+#include "inja.hpp"
+#include "nlohmann/json.hpp"
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The 'pack' built-in before formats were compiled
+static std::string legacy_pack(const std::string &format, const nlohmann::json &data, inja::Environment &inja_env, const nlohmann::json &generated_json)
+{
+  std::vector<std::byte> data_output;
+  auto i = format.begin();
+  for (auto d: data) {
+    auto v       = yakka::try_render(inja_env, d.get<std::string>(), generated_json);
+    const char c = *i++;
+    if (i == format.end())
+      i = format.begin();
+    union {
+      int32_t s32;
+      uint32_t u32;
+      std::byte bytes[8];
+    } temp;
+    (v.size() > 1 && v[1] == 'x') ? std::from_chars(v.data() + 2, v.data() + v.size(), temp.u32, 16)
+    : (v[0] == '-')               ? std::from_chars(v.data(), v.data() + v.size(), temp.s32)
+                                  : std::from_chars(v.data(), v.data() + v.size(), temp.u32);
+    switch (c) {
+      case 'L':
+      case 'l':
+        data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[4]);
+        break;
+      case 'S':
+      case 's':
+        data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[2]);
+        break;
+      case 'C':
+      case 'c':
+        data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[1]);
+        break;
+      case 'x':
+        data_output.push_back(std::byte{ 0 });
+        break;
+    }
+  }
+  std::string captured_output;
+  auto *chars = reinterpret_cast<char const *>(data_output.data());
+  captured_output.insert(captured_output.end(), chars, chars + data_output.size());
+  return captured_output;
+}
+
+// The 'pack' built-in with a compiled format. Only values with template markup are rendered.
+static std::string compiled_pack(const std::string &format, const nlohmann::json &data, inja::Environment &inja_env, const nlohmann::json &generated_json)
+{
+  std::vector<uint64_t> values;
+  values.reserve(data.size());
+  for (const auto &d: data) {
+    uint64_t value   = 0;
+    const auto &text = d.get_ref<const std::string &>();
+    yakka::parse_pack_value(std::string_view{ yakka::has_template_markup(text) ? yakka::try_render(inja_env, text, generated_json) : text }, value);
+    values.push_back(value);
+  }
+  std::string output;
+  yakka::pack_format::get(format)->pack(values, output);
+  return output;
+}
+
+// The 'pack' built-in reading a numeric array from a data file
+static std::string bulk_pack(const std::string &format, const nlohmann::json &data)
+{
+  std::vector<uint64_t> values;
+  values.reserve(data.size());
+  for (const auto &d: data) {
+    uint64_t value = 0;
+    yakka::parse_pack_value(d, value);
+    values.push_back(value);
+  }
+  std::string output;
+  yakka::pack_format::get(format)->pack(values, output);
+  return output;
+}
+
+template<typename F> static double time_ms(F f, std::string &output)
+{
+  const auto start = std::chrono::steady_clock::now();
+  output           = f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+  const size_t count       = argc > 1 ? std::stoul(argv[1]) : 50000;
+  const std::string format = "LSCL";
+
+  nlohmann::json string_data = nlohmann::json::array();
+  nlohmann::json number_data = nlohmann::json::array();
+  for (size_t i = 0; i < count; ++i) {
+    const uint64_t value = (i * 2654435761u) & 0xFFFFFFFF;
+    char hex[16];
+    string_data.push_back(i % 2 ? std::to_string(value) : "0x" + std::string(hex, std::to_chars(hex, hex + sizeof(hex), value, 16).ptr));
+    number_data.push_back(value);
+  }
+
+  inja::Environment inja_env;
+  nlohmann::json generated_json = nlohmann::json::object();
+  std::string legacy_output;
+  std::string compiled_output;
+  std::string bulk_output;
+
+  nlohmann::json results;
+  results["values"]      = count;
+  results["format"]      = format;
+  results["legacy_ms"]   = time_ms([&]() { return legacy_pack(format, string_data, inja_env, generated_json); }, legacy_output);
+  results["compiled_ms"] = time_ms([&]() { return compiled_pack(format, string_data, inja_env, generated_json); }, compiled_output);
+  results["bulk_ms"]     = time_ms([&]() { return bulk_pack(format, number_data); }, bulk_output);
+  results["bytes"]       = compiled_output.size();
+  results["identical"]   = legacy_output == compiled_output && compiled_output == bulk_output;
+  std::cout << results.dump(2) << "\n";
+  return results["identical"].get<bool>() ? 0 : 1;
+}
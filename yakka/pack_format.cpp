@@ -0,0 +1,164 @@
+#include "pack_format.hpp"
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace yakka {
+pack_format::pack_format(std::string_view format)
+{
+  auto c = format.begin();
+  if (c != format.end()) {
+    switch (*c) {
+      case '<':
+        big_endian = false;
+        ++c;
+        break;
+      case '>':
+      case '!':
+        big_endian = true;
+        ++c;
+        break;
+      case '=':
+        ++c;
+        break;
+    }
+  }
+
+  while (c != format.end()) {
+    if (*c == ' ') {
+      ++c;
+      continue;
+    }
+
+    size_t count = 1;
+    if (*c >= '0' && *c <= '9') {
+      const auto result = std::from_chars(&*c, format.data() + format.size(), count);
+      c += result.ptr - &*c;
+      if (c == format.end())
+        throw std::invalid_argument("Missing pack type after repeat count");
+    }
+
+    field f;
+    switch (*c++) {
+      case 'L':
+      case 'l':
+        f = { 4, false };
+        break;
+      case 'S':
+      case 's':
+        f = { 2, false };
+        break;
+      case 'C':
+      case 'c':
+        f = { 1, false };
+        break;
+      case 'x':
+        f = { 1, true };
+        break;
+      default:
+        throw std::invalid_argument("Unknown pack type '" + std::string(1, *(c - 1)) + "'");
+    }
+    fields.insert(fields.end(), count, f);
+    packed_size += count * f.size;
+  }
+}
+
+std::shared_ptr<const pack_format> pack_format::get(const std::string &format)
+{
+  static std::shared_mutex lock;
+  static std::unordered_map<std::string, std::shared_ptr<const pack_format>> formats;
+  {
+    std::shared_lock guard(lock);
+    auto existing = formats.find(format);
+    if (existing != formats.end())
+      return existing->second;
+  }
+
+  auto compiled = std::make_shared<const pack_format>(format);
+  std::unique_lock guard(lock);
+  formats.try_emplace(format, compiled);
+  return compiled;
+}
+
+void pack_format::pack(const std::vector<uint64_t> &values, std::string &output) const
+{
+  if (fields.empty() || values.empty())
+    return;
+
+  // Size the output for every complete pass and any trailing fields, then write in place
+  const size_t passes = values.size() / fields.size();
+  size_t size         = passes * packed_size;
+  for (size_t i = 0; i < values.size() % fields.size(); ++i)
+    size += fields[i].size;
+
+  size_t position = output.size();
+  output.resize(position + size);
+  char *out = output.data();
+
+  size_t field_index = 0;
+  for (const auto value: values) {
+    const auto &f = fields[field_index];
+    if (f.padding) {
+      out[position] = 0;
+    } else {
+      // Values are truncated to the field size keeping the low-order bytes
+      if (big_endian)
+        for (int b = 0; b < f.size; ++b)
+          out[position + f.size - 1 - b] = static_cast<char>(value >> (8 * b));
+      else if (std::endian::native == std::endian::little)
+        std::memcpy(out + position, &value, f.size);
+      else
+        for (int b = 0; b < f.size; ++b)
+          out[position + b] = static_cast<char>(value >> (8 * b));
+    }
+    position += f.size;
+    if (++field_index == fields.size())
+      field_index = 0;
+  }
+}
+
+bool parse_pack_value(std::string_view text, uint64_t &value)
+{
+  if (text.empty())
+    return false;
+  const char *begin = text.data();
+  const char *end   = text.data() + text.size();
+  std::from_chars_result result;
+  if (text.size() > 1 && text[1] == 'x') {
+    result = std::from_chars(begin + 2, end, value, 16);
+  } else if (text[0] == '-') {
+    int64_t signed_value = 0;
+    result               = std::from_chars(begin, end, signed_value);
+    value                = static_cast<uint64_t>(signed_value);
+  } else {
+    result = std::from_chars(begin, end, value);
+  }
+  return result.ec == std::errc();
+}
+
+bool parse_pack_value(const nlohmann::json &node, uint64_t &value)
+{
+  switch (node.type()) {
+    case nlohmann::json::value_t::number_unsigned:
+      value = node.get<uint64_t>();
+      return true;
+    case nlohmann::json::value_t::number_integer:
+      value = static_cast<uint64_t>(node.get<int64_t>());
+      return true;
+    case nlohmann::json::value_t::number_float:
+      value = static_cast<uint64_t>(static_cast<int64_t>(node.get<double>()));
+      return true;
+    case nlohmann::json::value_t::boolean:
+      value = node.get<bool>() ? 1 : 0;
+      return true;
+    case nlohmann::json::value_t::string:
+      return parse_pack_value(std::string_view{ node.get_ref<const std::string &>() }, value);
+    default:
+      return false;
+  }
+}
+} // namespace yakka
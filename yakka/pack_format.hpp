@@ -0,0 +1,49 @@
+#pragma once
+
+#include "nlohmann/json.hpp"
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace yakka {
+/**
+ * @brief A 'pack' format string compiled to a list of fields.
+ *        The format is an optional byte order, '<' little, '>' or '!' big, '=' native (the default), followed by fields.
+ *        A field is an optional repeat count and a type: 'L'/'l' 32-bit, 'S'/'s' 16-bit, 'C'/'c' 8-bit or 'x' a zero byte.
+ *        Every field consumes one value, including 'x'. The fields are repeated until the values run out.
+ */
+class pack_format {
+public:
+  explicit pack_format(std::string_view format);
+
+  // Returns the compiled format for a format string. Each format string is only compiled once per run.
+  static std::shared_ptr<const pack_format> get(const std::string &format);
+
+  // Packs values and appends them to output. Output is grown once for all the values.
+  void pack(const std::vector<uint64_t> &values, std::string &output) const;
+
+  size_t field_count() const
+  {
+    return fields.size();
+  }
+
+private:
+  struct field {
+    uint8_t size;
+    bool padding;
+  };
+
+  std::vector<field> fields;
+  size_t packed_size = 0; // Bytes for one pass over the fields
+  bool big_endian    = std::endian::native == std::endian::big;
+};
+
+// Parses a 'pack' value. Accepts '0x' hex, negative and unsigned decimal numbers. Returns false if the text is not a number.
+bool parse_pack_value(std::string_view text, uint64_t &value);
+
+// Converts a JSON number, bool or numeric string to a 'pack' value
+bool parse_pack_value(const nlohmann::json &node, uint64_t &value);
+} // namespace yakka
@@ -0,0 +1,129 @@
+// Checks that the build server only reruns the targets that depend on a changed source, and that it drops a client that sends no request.
+// Usage: server_test <yakka executable>. Requires Linux. Generates a workspace in a temporary directory, starts 'yakka serve' in it,
+// prints the checks as JSON and returns non-zero if any fail.
+#include "yakka.hpp"
+#include "utilities.hpp"
+#include "spdlog/spdlog.h"
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const char *app_component = R"(name: app
+blueprints:
+  all:
+    depends:
+      - "{{project_output}}/x.out"
+      - "{{project_output}}/y.out"
+  "{{project_output}}/x.out":
+    depends:
+      - "{{curdir}}/x.c"
+    process:
+      - echo: "built x"
+      - save:
+  "{{project_output}}/y.out":
+    depends:
+      - "{{curdir}}/y.c"
+    process:
+      - echo: "built y"
+      - save:
+)";
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+static pid_t start_server(const fs::path &yakka_executable)
+{
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    const int null_fd = ::open("/dev/null", O_WRONLY);
+    ::dup2(null_fd, STDOUT_FILENO);
+    ::dup2(null_fd, STDERR_FILENO);
+    ::execl(yakka_executable.c_str(), yakka_executable.c_str(), "serve", nullptr);
+    ::_exit(127);
+  }
+  return pid;
+}
+
+// Returns the lines the build echoed, or "failed" if the build didn't complete
+static std::string build(const fs::path &yakka_executable)
+{
+  auto [output, result] = yakka::exec("timeout 60 \"" + yakka_executable.string() + "\"", "--server all! app");
+  if (result != 0 || output.find("Complete in") == std::string::npos)
+    return "failed";
+  std::string built;
+  for (const auto *target: { "built x", "built y" })
+    if (output.find(target) != std::string::npos)
+      built += built.empty() ? target : std::string(", ") + target;
+  return built;
+}
+
+int main(int argc, char **argv)
+{
+  spdlog::set_level(spdlog::level::off);
+  if (argc < 2) {
+    std::cerr << "Usage: server_test <yakka executable>\n";
+    return 1;
+  }
+
+  const auto yakka_executable   = fs::absolute(argv[1]);
+  const auto root               = fs::temp_directory_path() / "yakka_server_test";
+  const auto original_directory = fs::current_path();
+  fs::remove_all(root);
+  write_file(root / "components" / "app" / "app.yakka", app_component);
+  write_file(root / "components" / "app" / "x.c", "x\n");
+  write_file(root / "components" / "app" / "y.c", "y\n");
+  fs::current_path(root);
+
+  const pid_t server = start_server(yakka_executable);
+  for (int i = 0; i < 100 && !fs::exists(".yakka/server.sock"); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  nlohmann::json results                   = nlohmann::json::object();
+  results["first build runs every target"] = build(yakka_executable) == "built x, built y";
+
+  // Give the new timestamp a clear lead and the watch time to see the change
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  write_file(root / "components" / "app" / "x.c", "x changed\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  results["changed source reruns only its target"] = build(yakka_executable) == "built x";
+  results["unchanged build runs nothing"]          = build(yakka_executable) == "";
+
+  // A build requested behind a client that never sends anything is served once that client is dropped
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, ".yakka/server.sock", sizeof(address.sun_path) - 1);
+  const int stalled_fd                 = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  const bool connected                 = ::connect(stalled_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+  results["stalled client is dropped"] = connected && build(yakka_executable) == "";
+  ::close(stalled_fd);
+
+  ::kill(server, SIGTERM);
+  int status = 0;
+  ::waitpid(server, &status, 0);
+  results["server stops cleanly"] = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+  fs::current_path(original_directory);
+  fs::remove_all(root);
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  return passed ? 0 : 1;
+}
@@ -1,71 +1,208 @@
-#include "slc_project.h"
-#include <filesystem>
-#include <unordered_set>
-#include <thread>
-#include <vector>
-#include <future>
+#include "slc_project.hpp"
+#include "spdlog/spdlog.h"
+#include <algorithm>
 
 /*
-1. We start with a list of components (C).
-2. These components all have requirements and provides. These are aggregated into a set of requirements (R) and a set of provides (P) for the project.
-3. The set of unsatisfied requirements is the set of requirements minus the set of provides (UR=R-P).
-4. Loop over the set of unsatisfied requirements (UR):
+1. We start with a set of required features (R) and a set of provided features (P).
+2. The set of unsatisfied requirements is the set of requirements minus the set of provides (UR=R-P).
+3. Loop over the set of unsatisfied requirements (UR):
    a. Find all components that provide the unsatisfied requirement
-      i. If all conditions on a provide is in the combined set of provides and requirements (R+P), the new provide is considered.
-        (This means that all requirements are implicitly considered as provided when we look for provides. The reason for this is that they will be provided at some point, thereby including the provide, or the project resolution will fail.)
-   b. If only one new component was found: it is added to the list of components for the project (C).
-5. If we added at least one new component to the list of components during step 4 we jump back to step 1 and start again.
-6. We have reached steady-state, and inspect the results.
-   a. If the set of requirements is covered by the set of provides, and no two components give the same provide, the project has been resolved successfully.
-   b. If not the project resolution failed
+      i. An option is only considered if all of its conditions are required and none of its unless features are required.
+   b. If exactly one recommended option is enabled it is added to the project.
+   c. Otherwise if exactly one other option is enabled it is added to the project.
+4. Adding a component changes R and P so the caller repeats this pass until steady-state.
+5. Any requirements left are reported by the caller.
+
+All of R, P, the conditions and the unless lists are bitsets over interned feature IDs.
 */
 
-void slc_project::resolve_project(std::unordered_set<std::string> components)
+namespace yakka {
+void feature_set::set(size_t id)
 {
-  std::vector<std::string> unsatisified_requirements;
-  std::unordered_set<std::string>
-  requires;
-  std::unordered_set<std::string> provides;
-
-  // Get the list of unsatisified requirements
-  std::set_difference(requires.begin(), requires.end(), provides.begin(), provides.end(), std::inserter(unsatisified_requirements, unsatisified_requirements.begin()));
-
-  for (const auto &r: unsatisified_requirements) {
-    // Get all the components that provide the requirement
-    auto p = provided_requirements.equal_range(r);
-    for (auto i = p.first; i != p.second; ++i) {
-      // Check conditions of
-    }
+  if (id / 64 >= words.size())
+    words.resize(id / 64 + 1, 0);
+  words[id / 64] |= uint64_t(1) << (id % 64);
+}
+
+bool feature_set::test(size_t id) const
+{
+  return id / 64 < words.size() && (words[id / 64] & (uint64_t(1) << (id % 64))) != 0;
+}
+
+void feature_set::clear()
+{
+  std::fill(words.begin(), words.end(), 0);
+}
+
+bool feature_set::is_subset_of(const feature_set &other) const
+{
+  for (size_t w = 0; w < words.size(); ++w) {
+    const uint64_t other_word = w < other.words.size() ? other.words[w] : 0;
+    if ((words[w] & ~other_word) != 0)
+      return false;
   }
+  return true;
 }
 
-void slc_project::generate_slcc_database(const std::string path)
+bool feature_set::intersects(const feature_set &other) const
 {
-  std::vector<std::future<YAML::Node>> parsed_slcc_files;
-  for (const auto &p: std::filesystem::recursive_directory_iterator(path)) {
-    if (p.path().filename().extension() == ".slcc") {
-      parsed_slcc_files.push_back(std::async(
-        std::launch::async,
-        [](std::string path) -> YAML::Node {
-          try {
-            return YAML::LoadFile(path);
-          } catch (...) {
-            return {};
-          }
-        },
-        p.path().generic_string()));
-    }
+  const size_t count = std::min(words.size(), other.words.size());
+  for (size_t w = 0; w < count; ++w)
+    if ((words[w] & other.words[w]) != 0)
+      return true;
+  return false;
+}
+
+feature_set &feature_set::operator-=(const feature_set &other)
+{
+  const size_t count = std::min(words.size(), other.words.size());
+  for (size_t w = 0; w < count; ++w)
+    words[w] &= ~other.words[w];
+  return *this;
+}
+
+slc_project::feature_id slc_project::intern(const std::string &name)
+{
+  auto [it, inserted] = feature_ids.try_emplace(name, static_cast<feature_id>(feature_names.size()));
+  if (inserted)
+    feature_names.push_back(name);
+  return it->second;
+}
+
+void slc_project::clear_cache()
+{
+  providers.clear();
+  recommendation_filters.clear();
+}
+
+// Marks a feature as provided by a component added during the current pass
+void slc_project::provide(const std::string &feature)
+{
+  provided.set(intern(feature));
+}
+
+void slc_project::update(const std::unordered_set<std::string> &required_features, const std::unordered_set<std::string> &provided_features)
+{
+  required.clear();
+  for (const auto &f: required_features)
+    required.set(intern(f));
+
+  provided.clear();
+  for (const auto &f: provided_features)
+    provided.set(intern(f));
+}
+
+feature_set slc_project::compile_features(const nlohmann::json &node, const std::string &key)
+{
+  feature_set features;
+  if (node.is_object() && node.contains(key))
+    for (const auto &f: node[key])
+      features.set(intern(f.get<std::string>()));
+  return features;
+}
+
+bool slc_project::is_enabled(const feature_set &condition, const feature_set &unless) const
+{
+  return condition.is_subset_of(required) && !unless.intersects(required);
+}
+
+/**
+ * @brief Returns the compiled provider options for a feature, looking them up in the workspace the first time the feature is seen
+ */
+const std::optional<std::vector<slc_project::provider_option>> &slc_project::find_providers(feature_id id)
+{
+  auto cached = providers.find(id);
+  if (cached != providers.end())
+    return cached->second;
+
+  auto &entry       = providers[id];
+  auto feature_node = find_feature(feature_names[id]);
+  if (!feature_node.has_value())
+    return entry;
+
+  std::vector<provider_option> options;
+  for (const auto &option: feature_node.value()) {
+    if (option.is_object())
+      options.push_back({ option["name"].get<std::string>(), compile_features(option, "condition"), compile_features(option, "unless") });
+    else
+      options.push_back({ option.get<std::string>(), {}, {} });
   }
+  entry = std::move(options);
+  return entry;
+}
+
+/**
+ * @brief Makes a single pass over the requirements, adding a component for each requirement that has exactly one enabled provider.
+ *        The feature sets are loaded once. Features provided by components added during the pass are marked through provide().
+ * @return The requirements that could not be resolved
+ */
+std::unordered_set<std::string> slc_project::resolve_project(std::unordered_set<std::string> requirements,
+                                                             const std::unordered_set<std::string> &required_features,
+                                                             const std::unordered_set<std::string> &provided_features,
+                                                             const std::map<std::string, const nlohmann::json> &recommendations)
+{
+  std::unordered_set<std::string> unresolved;
+  update(required_features, provided_features);
+
+  feature_set unsatisfied;
+  for (const auto &r: requirements)
+    unsatisfied.set(intern(r));
+  unsatisfied -= provided;
 
-  for (const auto &i: parsed_slcc_files) {
-    YAML::Node result = i.wait().value();
-    if (!result.IsNull()) {
-      // Add component to the database
-      slcc_database[result["name"].as<std::string>()] = result;
+  unsatisfied.for_each([&](size_t id) {
+    // Adding a component in this pass may have provided the requirement
+    if (provided.test(id))
+      return;
 
-      // Extra the 'provides' into the universal multimap
-      for (const auto &p: result["provides"])
-        provided_requirements.insert({ p.as<std::string>(), result });
+    const auto r        = feature_names[id];
+    const auto &options = find_providers(id);
+    if (!options.has_value()) {
+      unresolved.insert(r);
+      return;
     }
-  }
-}
\ No newline at end of file
+
+    std::vector<std::string> recommended_options;
+    std::vector<std::string> other_options;
+    auto add_unique = [](std::vector<std::string> &list, const std::string &name) {
+      if (std::find(list.begin(), list.end(), name) == list.end())
+        list.push_back(name);
+    };
+
+    // Go through possible options ignoring the ones that are excluded
+    for (const auto &option: options.value()) {
+      if (!is_enabled(option.condition, option.unless))
+        continue;
+
+      // If this is recommended add to the recommended list, otherwise add to other options list
+      const auto recommendation = recommendations.find(option.name);
+      if (recommendation != recommendations.end()) {
+        auto filter = recommendation_filters.find(option.name);
+        if (filter == recommendation_filters.end())
+          filter = recommendation_filters.insert({ option.name, { compile_features(recommendation->second, "condition"), compile_features(recommendation->second, "unless") } }).first;
+        if (is_enabled(filter->second.first, filter->second.second))
+          add_unique(recommended_options, option.name);
+      } else {
+        add_unique(other_options, option.name);
+      }
+    }
+
+    // If there is more than 1 recommendation, the user must decide
+    // If there is a single recommendation, use that
+    // If there are no recommendations but only 1 option, use that
+    if (recommended_options.size() > 1) {
+      spdlog::error("Multiple recommendations for '{}'", r);
+      unresolved.insert(r);
+    } else if (recommended_options.size() == 1) {
+      const auto name = recommended_options.front();
+      add_component(name, r, &recommendations.at(name));
+    } else if (other_options.size() == 1) {
+      const auto name = other_options.front();
+      add_component(name, r, nullptr);
+    } else {
+      unresolved.insert(r);
+    }
+  });
+
+  return unresolved;
+}
+} // namespace yakka
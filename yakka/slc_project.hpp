@@ -1,13 +1,80 @@
 #pragma once
-#include "yaml-cpp/yaml.h"
-#include <unordered_set>
+
+#include "nlohmann/json.hpp"
+#include <string>
+#include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <functional>
+#include <bit>
+#include <cstdint>
+
+namespace yakka {
+/**
+ * @brief Set of SLC features stored as a bitset indexed by dense feature ID
+ */
+class feature_set {
+public:
+  void set(size_t id);
+  bool test(size_t id) const;
+  void clear();
+  bool is_subset_of(const feature_set &other) const;
+  bool intersects(const feature_set &other) const;
+  feature_set &operator-=(const feature_set &other);
+
+  // Calls f(id) for every set bit in ascending order
+  template<typename F> void for_each(F f) const
+  {
+    for (size_t w = 0; w < words.size(); ++w)
+      for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+        f(w * 64 + std::countr_zero(bits));
+  }
 
+  std::vector<uint64_t> words;
+};
+
+/**
+ * @brief Resolves SLC feature requirements to the components that provide them.
+ *        Feature names are interned to dense IDs so requirement, provide, condition and unless checks are word-parallel bitset operations.
+ */
 class slc_project {
 public:
-  std::multimap<std::string, YAML::Node> provided_requirements;
-  std::map<std::string, YAML::Node> slcc_database;
+  typedef uint32_t feature_id;
+
+  // A component that can provide a feature and the features that enable or disable it
+  struct provider_option {
+    std::string name;
+    feature_set condition;
+    feature_set unless;
+  };
+
+  // Looks up the provider options for a feature
+  std::function<std::optional<nlohmann::json>(const std::string &feature)> find_feature;
+
+  // Adds a component to satisfy a requirement. recommendation is null if the component was the only option.
+  std::function<void(const std::string &component, const std::string &requirement, const nlohmann::json *recommendation)> add_component;
+
+  feature_id intern(const std::string &name);
+  void provide(const std::string &feature);
+  std::unordered_set<std::string> resolve_project(std::unordered_set<std::string> requirements,
+                                                  const std::unordered_set<std::string> &required_features,
+                                                  const std::unordered_set<std::string> &provided_features,
+                                                  const std::map<std::string, const nlohmann::json> &recommendations);
+  void clear_cache();
+
+private:
+  void update(const std::unordered_set<std::string> &required_features, const std::unordered_set<std::string> &provided_features);
+  feature_set compile_features(const nlohmann::json &node, const std::string &key);
+  const std::optional<std::vector<provider_option>> &find_providers(feature_id id);
+  bool is_enabled(const feature_set &condition, const feature_set &unless) const;
 
-  void resolve_project(std::unordered_set<std::string> components);
-  void generate_slcc_database(const std::string path);
-};
\ No newline at end of file
+  std::unordered_map<std::string, feature_id> feature_ids;
+  std::vector<std::string> feature_names;
+  feature_set required;
+  feature_set provided;
+  std::unordered_map<feature_id, std::optional<std::vector<provider_option>>> providers;
+  std::unordered_map<std::string, std::pair<feature_set, feature_set>> recommendation_filters;
+};
+} // namespace yakka
@@ -0,0 +1,105 @@
+// Checks that replacing an SLC component during dependency evaluation removes everything the replaced component added to the SLC state.
+// Usage: slc_replacement_test. Generates a workspace in a temporary directory, prints the checks as JSON and returns non-zero if any fail.
+#include "yakka.hpp"
+#include "yakka_workspace.hpp"
+#include "yakka_project.hpp"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// 'board_old' is added in the first pass. 'board_new' is only reached through 'middle', so it replaces 'board_old' in the second pass.
+static const char *app_component       = "name: app\nrequires:\n  components:\n    - board_old\n    - middle\n";
+static const char *middle_component    = "name: middle\nrequires:\n  components:\n    - board_new\n";
+static const char *board_old_component = R"(id: board_old
+label: Old board
+description: Replaced by board_new
+category: test
+quality: production
+package: test
+provides:
+  - name: board
+  - name: old_board_feature
+instances:
+  board_old:
+    - old_instance
+config_file:
+  - path: config/old_board_config.h
+    override:
+      component: board_support
+      file_id: board_config
+)";
+static const char *board_new_component = R"(id: board_new
+label: New board
+description: Replaces board_old
+category: test
+quality: production
+package: test
+provides:
+  - name: board
+  - name: new_board_feature
+replaces:
+  component: board_old
+)";
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+int main(int argc, char **argv)
+{
+  spdlog::set_level(spdlog::level::off);
+
+  const auto root               = fs::temp_directory_path() / "yakka_slc_replacement_test";
+  const auto original_directory = fs::current_path();
+  fs::remove_all(root);
+  write_file(root / "components" / "app.yakka", app_component);
+  write_file(root / "components" / "middle.yakka", middle_component);
+  write_file(root / "components" / "board_old" / "board_old.slcc", board_old_component);
+  write_file(root / "components" / "board_new" / "board_new.slcc", board_new_component);
+  fs::current_path(root);
+
+  nlohmann::json results = nlohmann::json::object();
+  {
+    yakka::workspace workspace;
+    workspace.init(".");
+
+    yakka::project project("test", workspace);
+    project.init_project({ "app" }, {});
+    project.evaluate_dependencies();
+
+    const bool has_board_old = std::any_of(project.components.begin(), project.components.end(), [](const auto &c) {
+      return c->id == "board_old";
+    });
+    const bool has_board_new = std::any_of(project.components.begin(), project.components.end(), [](const auto &c) {
+      return c->id == "board_new";
+    });
+    const bool has_old_instance = std::any_of(project.instances.begin(), project.instances.end(), [](const auto &i) {
+      return i.second == "old_instance";
+    });
+
+    results["replaced component removed"]          = !has_board_old && project.retraction_count != 0;
+    results["replacing component added"]           = has_board_new;
+    results["shared feature still provided"]       = project.slc_provided.contains("board");
+    results["replaced feature no longer provided"] = !project.slc_provided.contains("old_board_feature");
+    results["replacing feature provided"]          = project.slc_provided.contains("new_board_feature");
+    results["replaced override removed"]           = !project.slc_overrides.contains("board_config");
+    results["replaced instance removed"]           = !has_old_instance;
+  }
+
+  fs::current_path(original_directory);
+  fs::remove_all(root);
+
+  bool passed = true;
+  for (const auto &[check, result]: results.items())
+    passed = passed && result.get<bool>();
+
+  std::cout << results.dump(2) << "\n";
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+// Checks the SLC feature resolver against the original resolution that checked every provider option against the required features on each pass.
+// Usage: slc_resolver_test. Prints the result of each case as JSON and returns non-zero if the resolutions differ.
+#include "slc_project.hpp"
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_set>
+
+// Components of a small SLC project. Provides can have conditions and unless lists, and recommendations can be conditional or create instances.
+static const auto fixture_components = R"({
+  "app": {
+    "requires": [ "kernel", "heap", "log", "driver", "timer" ],
+    "recommends": [
+      { "id": "heap_4", "unless": [ "small" ] },
+      { "id": "heap_1", "condition": [ "tiny" ] },
+      { "id": "log_rtt", "condition": [ "debug" ] },
+      { "id": "%extension-board%uart_usart", "instance": [ "vcom", "exp" ] }
+    ]
+  },
+  "kernel_freertos": { "provides": [ "kernel" ], "requires": [ "port", "timer" ] },
+  "port_m33": { "provides": [ { "name": "port", "condition": [ "cortexm33" ] } ] },
+  "port_m4": { "provides": [ { "name": "port", "condition": [ "cortexm4" ] } ] },
+  "heap_1": { "provides": [ "heap" ] },
+  "heap_4": { "provides": [ "heap" ] },
+  "log_uart": { "provides": [ { "name": "log", "unless": [ "no_uart" ] } ], "requires": [ "uart" ] },
+  "log_rtt": { "provides": [ "log" ] },
+  "uart_usart": { "provides": [ "uart" ] },
+  "uart_eusart": { "provides": [ { "name": "uart", "condition": [ "eusart" ] } ] },
+  "driver_a": { "provides": [ { "name": "driver", "condition": [ "board_a" ] } ], "requires": [ "bus", "dma" ] },
+  "driver_b": { "provides": [ { "name": "driver", "condition": [ "board_b" ], "unless": [ "legacy" ] } ], "requires": [ "dma", "bus", "missing_feature" ] },
+  "bus_combo": { "provides": [ "bus", "dma", "timer" ] },
+  "dma_only": { "provides": [ "dma" ] },
+  "timer_sw": { "provides": [ { "name": "timer", "unless": [ "cortexm4" ] } ] }
+})"_json;
+
+// Required features of each case, as given with --with
+static const auto fixture_cases = R"({
+  "m33_board_b": [ "cortexm33", "board_b" ],
+  "m4_board_a_no_uart": [ "cortexm4", "board_a", "no_uart" ],
+  "m33_debug": [ "cortexm33", "debug", "board_a" ],
+  "nothing": [],
+  "both_boards": [ "cortexm33", "board_a", "board_b" ],
+  "legacy_board_b": [ "cortexm33", "board_b", "legacy" ],
+  "small": [ "cortexm33", "small", "eusart" ],
+  "tiny": [ "cortexm4", "tiny", "debug", "no_uart" ]
+})"_json;
+
+// The project state changed by the SLC passes of project::evaluate_dependencies
+struct resolution {
+  std::set<std::string> components;
+  std::unordered_set<std::string> required; // slc_required
+  std::unordered_set<std::string> provided; // slc_provided
+  std::map<std::string, const nlohmann::json> recommended;
+  std::set<std::pair<std::string, std::string>> instances;
+};
+
+// Builds the feature providers the way the component database indexes them
+static nlohmann::json feature_providers()
+{
+  nlohmann::json features = nlohmann::json::object();
+  for (const auto &[name, component]: fixture_components.items()) {
+    if (!component.contains("provides"))
+      continue;
+    for (const auto &p: component["provides"]) {
+      if (p.is_string()) {
+        features[p.get<std::string>()].push_back(name);
+        continue;
+      }
+      nlohmann::json option = { { "name", name } };
+      if (p.contains("condition"))
+        option["condition"] = p["condition"];
+      if (p.contains("unless"))
+        option["unless"] = p["unless"];
+      features[p["name"].get<std::string>()].push_back(option);
+    }
+  }
+  return features;
+}
+
+// Mirrors the SLCC part of project::add_component. The resolver is told about new provides like project::add_component does.
+static void add_component(resolution &state, const std::string &name, yakka::slc_project *resolver)
+{
+  if (!state.components.insert(name).second)
+    return;
+
+  const auto &component = fixture_components[name];
+  if (component.contains("requires"))
+    for (const auto &f: component["requires"])
+      state.required.insert(f.get<std::string>());
+  if (component.contains("provides"))
+    for (const auto &p: component["provides"]) {
+      const auto feature = p.is_string() ? p.get<std::string>() : p["name"].get<std::string>();
+      if (state.provided.insert(feature).second && resolver)
+        resolver->provide(feature);
+    }
+  if (component.contains("recommends"))
+    for (const auto &r: component["recommends"]) {
+      auto id        = r["id"].get<std::string>();
+      auto start_pos = id.find('%');
+      auto end_pos   = id.rfind('%');
+      if (start_pos != std::string::npos && end_pos != std::string::npos && start_pos < end_pos)
+        id.erase(start_pos, end_pos - start_pos + 1);
+      state.recommended.insert({ id, r });
+    }
+}
+
+// The SLC pass of project::evaluate_dependencies before the bitset resolver
+static void legacy_pass(resolution &state, const nlohmann::json &features, const std::unordered_set<std::string> &required_features)
+{
+  auto condition_is_fulfilled = [&](const nlohmann::json &node) {
+    if (node.contains("condition"))
+      for (const auto &condition: node["condition"])
+        if (!required_features.contains(condition.get<std::string>()))
+          return false;
+    return true;
+  };
+  auto is_disqualified_by_unless = [&](const nlohmann::json &node) {
+    if (node.contains("unless"))
+      for (const auto &u: node["unless"])
+        if (required_features.contains(u.get<std::string>()))
+          return true;
+    return false;
+  };
+
+  std::unordered_set<std::string> temp_require_list = std::move(state.required);
+  state.required.clear();
+  for (const auto &r: temp_require_list) {
+    if (state.provided.contains(r))
+      continue;
+
+    // Check the databases
+    if (!features.contains(r)) {
+      state.required.insert(r);
+      continue;
+    }
+
+    const auto &feature_node = features[r];
+    std::unordered_set<std::string> recommended_options;
+    std::unordered_set<std::string> other_options;
+
+    // Go through possible options
+    for (const auto &option: feature_node) {
+      // Ignore if it is excluded
+      if (option.is_object() && (!condition_is_fulfilled(option) || is_disqualified_by_unless(option)))
+        continue;
+
+      const auto name = option.is_object() ? option["name"].get<std::string>() : option.get<std::string>();
+
+      // If this is recommended add to the recommended list, otherwise add to other options list
+      if (state.recommended.contains(name)) {
+        if (condition_is_fulfilled(state.recommended.at(name)) && !is_disqualified_by_unless(state.recommended.at(name)))
+          recommended_options.insert(name);
+      } else {
+        other_options.insert(name);
+      }
+    }
+
+    if (recommended_options.size() > 1) {
+      state.required.insert(r);
+    } else if (recommended_options.size() == 1) {
+      const auto name            = *recommended_options.begin();
+      const auto &recommend_node = state.recommended.at(name);
+      if (recommend_node.contains("instance"))
+        for (const auto &i: recommend_node["instance"])
+          state.instances.insert({ name, i.get<std::string>() });
+      add_component(state, name, nullptr);
+    } else if (other_options.size() == 1) {
+      add_component(state, *other_options.begin(), nullptr);
+    } else {
+      state.required.insert(r);
+    }
+  }
+}
+
+// The SLC pass of project::evaluate_dependencies using slc_project
+static void resolver_pass(resolution &state, yakka::slc_project &resolver, const std::unordered_set<std::string> &required_features)
+{
+  std::unordered_set<std::string> temp_require_list = std::move(state.required);
+  state.required.clear();
+  auto unresolved = resolver.resolve_project(std::move(temp_require_list), required_features, state.provided, state.recommended);
+  state.required.merge(unresolved);
+}
+
+// Adds the project component and repeats the SLC pass until no more components are added
+template<typename F> static resolution resolve(F pass)
+{
+  resolution state;
+  add_component(state, "app", nullptr);
+  for (size_t count = 0; count != state.components.size();) {
+    count = state.components.size();
+    pass(state);
+  }
+  return state;
+}
+
+static nlohmann::json to_json(const resolution &state)
+{
+  nlohmann::json result;
+  result["components"] = state.components;
+  result["unresolved"] = std::set<std::string>(state.required.begin(), state.required.end());
+  result["instances"]  = nlohmann::json::array();
+  for (const auto &[name, instance]: state.instances)
+    result["instances"].push_back({ name, instance });
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  // The resolver reports ambiguous recommendations on the default logger, which would mix with the results
+  spdlog::set_level(spdlog::level::off);
+
+  const auto features = feature_providers();
+  bool identical      = true;
+
+  nlohmann::json results = nlohmann::json::array();
+  for (const auto &[name, with]: fixture_cases.items()) {
+    const std::unordered_set<std::string> required_features = with.get<std::unordered_set<std::string>>();
+
+    const auto legacy = resolve([&](resolution &state) {
+      legacy_pass(state, features, required_features);
+    });
+
+    yakka::slc_project resolver;
+    resolver.find_feature = [&features](const std::string &feature) -> std::optional<nlohmann::json> {
+      if (!features.contains(feature))
+        return {};
+      return features[feature];
+    };
+    resolution *current    = nullptr;
+    resolver.add_component = [&](const std::string &component, const std::string &requirement, const nlohmann::json *recommendation) {
+      if (recommendation && recommendation->contains("instance"))
+        for (const auto &i: (*recommendation)["instance"])
+          current->instances.insert({ component, i.get<std::string>() });
+      add_component(*current, component, &resolver);
+    };
+    const auto bitset = resolve([&](resolution &state) {
+      current = &state;
+      resolver_pass(state, resolver, required_features);
+    });
+
+    nlohmann::json result;
+    result["case"]      = name;
+    result["legacy"]    = to_json(legacy);
+    result["resolver"]  = to_json(bitset);
+    result["identical"] = result["legacy"] == result["resolver"];
+    identical           = identical && result["identical"].get<bool>();
+    results.push_back(std::move(result));
+  }
+
+  std::cout << results.dump(2) << "\n";
+  return identical ? 0 : 1;
+}
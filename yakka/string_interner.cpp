@@ -0,0 +1,67 @@
+#include "string_interner.hpp"
+#include <cstring>
+#include <mutex>
+
+namespace yakka {
+interned_string string_interner::intern(std::string_view text)
+{
+  if (text.empty())
+    return {};
+
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const auto existing = strings.find(text);
+    if (existing != strings.end())
+      return interned_string(*existing);
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  const auto existing = strings.find(text);
+  if (existing != strings.end())
+    return interned_string(*existing);
+
+  // Strings larger than a quarter of a block get a block of their own so the current block isn't wasted
+  char *storage;
+  if (text.size() > block_size / 4) {
+    blocks.insert(blocks.begin(), std::make_unique<char[]>(text.size()));
+    storage = blocks.front().get();
+    block_bytes += text.size();
+  } else {
+    if (block_used + text.size() > block_size) {
+      blocks.push_back(std::make_unique<char[]>(block_size));
+      block_used = 0;
+      block_bytes += block_size;
+    }
+    storage = blocks.back().get() + block_used;
+    block_used += text.size();
+  }
+  std::memcpy(storage, text.data(), text.size());
+
+  const std::string_view stored(storage, text.size());
+  strings.insert(stored);
+  return interned_string(stored);
+}
+
+size_t string_interner::size() const
+{
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return strings.size();
+}
+
+size_t string_interner::memory_usage() const
+{
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return block_bytes + strings.size() * sizeof(std::string_view);
+}
+
+string_interner &get_string_interner()
+{
+  static string_interner interner;
+  return interner;
+}
+
+interned_string intern(std::string_view text)
+{
+  return get_string_interner().intern(text);
+}
+} // namespace yakka
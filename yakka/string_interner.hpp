@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace yakka {
+/**
+ * @brief Handle to a string held by the string interner. Equal strings share storage so comparison and hashing use the address alone.
+ *        The text remains valid for the lifetime of the program. A default constructed handle is the empty string.
+ */
+class interned_string {
+public:
+  interned_string() = default;
+
+  std::string_view view() const
+  {
+    return text;
+  }
+  std::string str() const
+  {
+    return std::string(text);
+  }
+  operator std::string_view() const
+  {
+    return text;
+  }
+  bool empty() const
+  {
+    return text.empty();
+  }
+  char front() const
+  {
+    return text.front();
+  }
+  size_t size() const
+  {
+    return text.size();
+  }
+  bool operator==(const interned_string &other) const
+  {
+    return text.data() == other.text.data();
+  }
+
+private:
+  friend class string_interner;
+  explicit interned_string(std::string_view text) : text(text)
+  {
+  }
+
+  std::string_view text;
+};
+
+/**
+ * @brief Table of unique strings stored in arena blocks. Target names and dependency paths are interned so the build graph holds each path once.
+ *        Interning is thread safe.
+ */
+class string_interner {
+public:
+  interned_string intern(std::string_view text);
+
+  size_t size() const;
+  size_t memory_usage() const;
+
+private:
+  static constexpr size_t block_size = 64 * 1024;
+
+  mutable std::shared_mutex mutex;
+  std::unordered_set<std::string_view> strings;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used  = block_size;
+  size_t block_bytes = 0;
+};
+
+// Returns the program wide string interner
+string_interner &get_string_interner();
+
+// Interns a string with the program wide string interner
+interned_string intern(std::string_view text);
+} // namespace yakka
+
+template<> struct std::hash<yakka::interned_string> {
+  size_t operator()(const yakka::interned_string &s) const noexcept
+  {
+    return std::hash<const char *>{}(s.view().data());
+  }
+};
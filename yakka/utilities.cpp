@@ -1,5 +1,7 @@
 #include "yakka_project.hpp"
 #include "utilities.hpp"
+#include "yakka_stats.hpp"
+#include "file_cache.hpp"
 #include "subprocess.hpp"
 #include "spdlog/spdlog.h"
 #include "glob/glob.h"
@@ -22,6 +24,8 @@ if(0 == CreateProcess(argv[2], params, NULL, NULL, false, 0, NULL, NULL, &si, &p
 */
 std::pair<std::string, int> exec(const std::string &command_text, const std::string &arg_text)
 {
+  static auto &stats = get_stat_counter("process");
+  scoped_stat_timer timer(stats);
   spdlog::info("{} {}", command_text, arg_text);
   try {
     std::string command = command_text;
@@ -51,6 +55,8 @@ std::pair<std::string, int> exec(const std::string &command_text, const std::str
 
 int exec(const std::string &command_text, const std::string &arg_text, std::function<void(std::string &)> function)
 {
+  static auto &stats = get_stat_counter("process");
+  scoped_stat_timer timer(stats);
   spdlog::info("{} {}", command_text, arg_text);
   try {
     std::string command = command_text;
@@ -241,7 +247,7 @@ std::vector<std::string> parse_gcc_dependency_file(const std::string &filename)
       line.pop_back();
     if (line.back() == '\r')
       line.pop_back();
-    dependencies.push_back(line.starts_with("./") ? line.substr(line.find_first_not_of("/", 2)) : line);
+    dependencies.push_back(std::string(strip_current_directory(line)));
   }
 
   return dependencies;
@@ -306,10 +312,262 @@ std::string component_dotname_to_id(const std::string dotname)
   return dotname.find_last_of(".") != std::string::npos ? dotname.substr(dotname.find_last_of(".") + 1) : dotname;
 }
 
+// Returns true if a string may contain inja markup and therefore must be rendered
+bool has_template_markup(const std::string &input)
+{
+  return input.find("{{") != std::string::npos || input.find("{%") != std::string::npos || input.find("{#") != std::string::npos || input.find("##") != std::string::npos;
+}
+
+nlohmann::json aggregate_cache::aggregate(const nlohmann::json &summary, const std::string &path, const std::function<std::string(const std::string &)> &render)
+{
+  static auto &stats = get_stat_counter("template aggregate");
+  scoped_stat_timer timer(stats);
+
+  std::shared_ptr<const entry> cached;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto i = entries.find(path);
+    if (i != entries.end())
+      cached = i->second;
+  }
+
+  if (!cached) {
+    static auto &collect_stats = get_stat_counter("template aggregate (collect)");
+    scoped_stat_timer collect_timer(collect_stats);
+    auto new_entry = std::make_shared<const entry>(collect(summary, path));
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    cached = entries.emplace(path, std::move(new_entry)).first->second;
+  }
+
+  if (cached->render_indices.empty())
+    return cached->value;
+
+  auto result = cached->value;
+  for (const auto i: cached->render_indices)
+    result[i] = render(result[i].get<std::string>());
+  return result;
+}
+
+void aggregate_cache::clear()
+{
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  entries.clear();
+}
+
+/**
+ * @brief Translates a Jinja template to inja. Tags are copied apart from the changes below and the text between them is copied unchanged.
+ *        - CRLF line endings become LF and a single trailing newline is removed, as Jinja does by default
+ *        - '-' at the start or end of a tag removes all whitespace, including newlines, before or after the tag and is then dropped
+ *        - Comments are removed
+ *        - 'elif' becomes 'else if'
+ *        - loop.index0, loop.index, loop.first and loop.last become loop.index, loop.index1, loop.is_first and loop.is_last
+ */
+static std::string jinja_to_inja(std::string_view source)
+{
+  static const std::regex loop_variable(R"(\bloop\.(index0|index|first|last)\b)");
+  auto is_space = [](char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+  };
+
+  std::string text;
+  text.reserve(source.size());
+  for (size_t i = 0; i < source.size(); ++i)
+    if (source[i] != '\r' || i + 1 == source.size() || source[i + 1] != '\n')
+      text.push_back(source[i]);
+  if (text.ends_with('\n'))
+    text.pop_back();
+
+  std::string output;
+  output.reserve(text.size());
+  size_t position = 0;
+  while (position < text.size()) {
+    const size_t open = text.find('{', position);
+    if (open == std::string::npos || open + 1 == text.size()) {
+      output.append(text, position);
+      break;
+    }
+    const char kind = text[open + 1];
+    if (kind != '{' && kind != '%' && kind != '#') {
+      output.append(text, position, open + 1 - position);
+      position = open + 1;
+      continue;
+    }
+    output.append(text, position, open - position);
+
+    size_t body = open + 2;
+    if (body < text.size() && text[body] == '-') {
+      while (!output.empty() && is_space(output.back()))
+        output.pop_back();
+      // A brace left at the end of the text would join the opening braces of the tag
+      if (!output.empty() && output.back() == '{') {
+        output.pop_back();
+        output += "{{ \"{\" }}";
+      }
+      ++body;
+    }
+
+    // Find the end of the tag. Closing braces inside string literals don't end it.
+    const std::string_view close = kind == '{' ? "}}" : (kind == '%' ? "%}" : "#}");
+    size_t end                   = body;
+    char quote                   = 0;
+    for (; end < text.size(); ++end) {
+      if (quote != 0) {
+        if (text[end] == '\\')
+          ++end;
+        else if (text[end] == quote)
+          quote = 0;
+      } else if (kind != '#' && (text[end] == '"' || text[end] == '\'')) {
+        quote = text[end];
+      } else if (text.compare(end, close.size(), close) == 0) {
+        break;
+      }
+    }
+    if (end >= text.size()) {
+      // Unterminated tags are left for inja to report
+      output.append(text, open);
+      break;
+    }
+
+    const bool strip_after = end > body && text[end - 1] == '-';
+    std::string content    = text.substr(body, end - body - (strip_after ? 1 : 0));
+    if (kind == '%') {
+      const auto keyword = content.find_first_not_of(" \t\r\n");
+      if (keyword != std::string::npos && content.compare(keyword, 4, "elif") == 0 && keyword + 4 < content.size() && is_space(content[keyword + 4]))
+        content.replace(keyword, 4, "else if");
+    }
+    if (kind != '#') {
+      output += '{';
+      output += kind;
+      size_t copied = 0;
+      for (auto m = std::sregex_iterator(content.begin(), content.end(), loop_variable); m != std::sregex_iterator(); ++m) {
+        const auto name = (*m)[1].str();
+        output.append(content, copied, m->position() - copied);
+        output += name == "index0" ? "loop.index" : (name == "index" ? "loop.index1" : (name == "first" ? "loop.is_first" : "loop.is_last"));
+        copied = m->position() + m->length();
+      }
+      output.append(content, copied);
+      output += close;
+    }
+
+    position = end + close.size();
+    if (strip_after)
+      while (position < text.size() && is_space(text[position]))
+        ++position;
+  }
+  return output;
+}
+
+jinja_template_cache::jinja_template_cache()
+{
+  add_common_template_commands(environment);
+}
+
+std::string jinja_template_cache::render(const std::string &filename, const nlohmann::json &data)
+{
+  static auto &stats = get_stat_counter("jinja template render");
+  scoped_stat_timer timer(stats);
+  const auto timestamp = timed_last_write_time(filename);
+
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto i = entries.find(filename);
+    if (i != entries.end() && i->second.timestamp == timestamp)
+      return environment.render(*i->second.compiled, data);
+  }
+
+  std::shared_ptr<const inja::Template> compiled;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto &cached = entries[filename];
+    if (!cached.compiled || cached.timestamp != timestamp) {
+      static auto &compile_stats = get_stat_counter("jinja template render (compile)");
+      scoped_stat_timer compile_timer(compile_stats);
+      cached.compiled  = std::make_shared<const inja::Template>(environment.parse(jinja_to_inja(get_file_cache().read(filename)->view())));
+      cached.timestamp = timestamp;
+    }
+    compiled = cached.compiled;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return environment.render(*compiled, data);
+}
+
+jinja_template_cache &get_jinja_template_cache()
+{
+  static jinja_template_cache cache;
+  return cache;
+}
+
+/**
+ * @brief Walks the summary components and data collecting the values at a path.
+ *        Object values are merged and everything else is appended. Strings that need rendering are recorded rather than rendered.
+ */
+aggregate_cache::entry aggregate_cache::collect(const nlohmann::json &summary, const std::string &path)
+{
+  entry result;
+  const auto pointer = json_pointer(path);
+  auto add_string    = [&](const nlohmann::json &value) {
+    if (has_template_markup(value.get_ref<const std::string &>()))
+      result.render_indices.push_back(result.value.size());
+    result.value.push_back(value);
+  };
+
+  // Loop through components, check if object path exists, if so add it to the aggregate
+  if (summary.contains("components"))
+    for (const auto &[c_key, c_value]: summary["components"].items()) {
+      if (!c_value.contains(pointer) || c_value[pointer].is_null())
+        continue;
+
+      const auto &v = c_value[pointer];
+      if (v.is_object())
+        for (const auto &[i_key, i_value]: v.items())
+          result.value[i_key] = i_value;
+      else if (v.is_array())
+        for (const auto &i: v)
+          if (i.is_object())
+            result.value.push_back(i);
+          else
+            add_string(i);
+      else
+        add_string(v);
+    }
+
+  // Check project data
+  if (summary.contains("data") && summary["data"].contains(pointer)) {
+    const auto &v = summary["data"][pointer];
+    if (v.is_object())
+      for (const auto &[i_key, i_value]: v.items())
+        result.value[i_key] = i_value;
+    else if (v.is_array())
+      for (const auto &i: v)
+        add_string(i);
+    else
+      add_string(v);
+  }
+
+  return result;
+}
+
+/**
+ * @brief Parses and renders a template, counting each step. Throws on template errors like inja::Environment::render().
+ */
+std::string render_template(inja::Environment &env, const std::string &input, const nlohmann::json &data)
+{
+  static auto &parse_stats  = get_stat_counter("template parse");
+  static auto &render_stats = get_stat_counter("template render");
+  inja::Template parsed;
+  {
+    scoped_stat_timer timer(parse_stats);
+    parsed = env.parse(input);
+  }
+  scoped_stat_timer timer(render_stats);
+  return env.render(parsed, data);
+}
+
 std::string try_render(inja::Environment &env, const std::string &input, const nlohmann::json &data)
 {
   try {
-    return env.render(input, data);
+    return render_template(env, input, data);
   } catch (std::exception &e) {
     spdlog::error("Template error: {}\n{}", input, e.what());
     return "";
@@ -318,6 +576,8 @@ std::string try_render(inja::Environment &env, const std::string &input, const n
 
 std::string try_render_file(inja::Environment &env, const std::string &filename, const nlohmann::json &data)
 {
+  static auto &stats = get_stat_counter("template render file");
+  scoped_stat_timer timer(stats);
   try {
     return env.render_file(filename, data);
   } catch (std::exception &e) {
@@ -375,22 +635,52 @@ void add_common_template_commands(inja::Environment &inja_env)
   inja_env.add_callback("hex2dec", 1, [](const inja::Arguments &args) {
     return std::stoul(args[0]->get<std::string>(), nullptr, 16);
   });
+  // File contents and parsed data are shared across the run. Callbacks return copies as inja takes ownership of the result.
   inja_env.add_callback("read_file", 1, [](const inja::Arguments &args) {
-    auto file = std::ifstream(args[0]->get<std::string>());
-    return std::string{ std::istreambuf_iterator<char>{ file }, {} };
+    try {
+      return std::string{ get_file_cache().read(args[0]->get<std::string>())->view() };
+    } catch (std::exception &e) {
+      return std::string{};
+    }
   });
   inja_env.add_callback("load_yaml", 1, [](const inja::Arguments &args) {
-    const auto file_path = args[0]->get<std::string>();
-    if (std::filesystem::exists(file_path)) {
-      auto yaml_data = YAML::LoadFile(file_path);
-      return yaml_data.as<nlohmann::json>();
-    } else {
-      return nlohmann::json();
-    }
+    return *get_file_cache().load_yaml(args[0]->get<std::string>());
   });
   inja_env.add_callback("load_json", 1, [](const inja::Arguments &args) {
-    std::ifstream file_stream(args[0]->get<std::string>());
-    return nlohmann::json::parse(file_stream);
+    return *get_file_cache().load_json(args[0]->get<std::string>());
+  });
+  inja_env.add_callback("unique", 1, [](const inja::Arguments &args) {
+    static auto &stats = get_stat_counter("template unique");
+    scoped_stat_timer timer(stats);
+    nlohmann::json filtered;
+    std::unordered_set<std::string> seen;
+    for (const auto &item: *args[0])
+      if (seen.insert(item.get<std::string>()).second)
+        filtered.push_back(item);
+    return filtered;
+  });
+  inja_env.add_callback("union", 2, [](const inja::Arguments &args) {
+    static auto &stats = get_stat_counter("template union");
+    scoped_stat_timer timer(stats);
+    nlohmann::json combined = nlohmann::json::array();
+    std::unordered_set<std::string> seen;
+    for (const auto &list: { args[0], args[1] })
+      for (const auto &item: *list)
+        if (seen.insert(item.get<std::string>()).second)
+          combined.push_back(item);
+    return combined;
+  });
+  inja_env.add_callback("difference", 2, [](const inja::Arguments &args) {
+    static auto &stats = get_stat_counter("template difference");
+    scoped_stat_timer timer(stats);
+    nlohmann::json remaining = nlohmann::json::array();
+    std::unordered_set<std::string> excluded;
+    for (const auto &item: *args[1])
+      excluded.insert(item.get<std::string>());
+    for (const auto &item: *args[0])
+      if (!excluded.contains(item.get<std::string>()))
+        remaining.push_back(item);
+    return remaining;
   });
   inja_env.add_callback("quote", 1, [](const inja::Arguments &args) {
     std::stringstream ss;
@@ -417,10 +707,10 @@ void add_common_template_commands(inja::Environment &inja_env)
 
 std::pair<std::string, int> run_command(const std::string target, construction_task *task, project *project)
 {
-  std::string captured_output = "";
-  inja::Environment inja_env  = inja::Environment();
-  auto &blueprint             = task->match;
-  std::string curdir_path     = blueprint->blueprint->parent_path;
+  yakka::process_data captured;
+  inja::Environment inja_env = inja::Environment();
+  auto &blueprint            = task->match;
+  std::string curdir_path    = blueprint->blueprint->parent_path;
   nlohmann::json data_store;
 
   add_common_template_commands(inja_env);
@@ -446,14 +736,6 @@ std::pair<std::string, int> run_command(const std::string target, construction_t
     data_store[ptr].push_back(*args[1]);
     return nlohmann::json{};
   });
-  inja_env.add_callback("unique", 1, [&](const inja::Arguments &args) {
-    nlohmann::json filtered;
-    std::copy_if(args[0]->cbegin(), args[0]->cend(), std::back_inserter(filtered), [&](const nlohmann::json &item) {
-      return std::find(filtered.begin(), filtered.end(), item.get<std::string>()) == filtered.end();
-    });
-    return filtered;
-  });
-
   inja_env.add_callback("fetch", 2, [&](const inja::Arguments &args) {
     nlohmann::json::json_pointer ptr{ args[0]->get<std::string>() };
     auto key = args[1]->get<std::string>();
@@ -481,42 +763,14 @@ std::pair<std::string, int> run_command(const std::string target, construction_t
   });
 
   inja_env.add_callback("aggregate", 1, [&](const inja::Arguments &args) {
-    nlohmann::json aggregate;
-    auto path = json_pointer(args[0]->get<std::string>());
-    // Loop through components, check if object path exists, if so add it to the aggregate
-    for (const auto &[c_key, c_value]: project->project_summary["components"].items()) {
-      // auto v = json_path(c.value(), path);
-      if (!c_value.contains(path) || c_value[path].is_null())
-        continue;
-
-      auto v = c_value[path];
-      if (v.is_object())
-        for (const auto &[i_key, i_value]: v.items()) {
-          aggregate[i_key] = i_value; //try_render(inja_env, i.second.as<std::string>(), project->project_summary, log);
-        }
-      else if (v.is_array())
-        for (const auto &[i_key, i_value]: v.items())
-          if (i_value.is_object())
-            aggregate.push_back(i_value);
-          else
-            aggregate.push_back(try_render(inja_env, i_value.get<std::string>(), project->project_summary));
-      else if (!v.is_null())
-        aggregate.push_back(try_render(inja_env, v.get<std::string>(), project->project_summary));
-    }
-
-    // Check project data
-    if (project->project_summary["data"].contains(path)) {
-      auto v = project->project_summary["data"][path];
-      if (v.is_object())
-        for (const auto &[i_key, i_value]: v.items())
-          aggregate[i_key] = i_value;
-      else if (v.is_array())
-        for (const auto &i: v)
-          aggregate.push_back(inja_env.render(i.get<std::string>(), project->project_summary));
-      else
-        aggregate.push_back(inja_env.render(v.get<std::string>(), project->project_summary));
-    }
-    return aggregate;
+    return project->aggregates.aggregate(project->project_summary, args[0]->get<std::string>(), [&](const std::string &input) {
+      return try_render(inja_env, input, project->project_summary);
+    });
+  });
+  // Structured output passed to the current step, such as from 'regex' with 'to_yaml'.
+  // Names that aren't in the template data are looked up as callbacks so templates can use it as 'input'
+  inja_env.add_callback("input", 0, [&captured](const inja::Arguments &args) {
+    return captured.value;
   });
   inja_env.add_callback("load_component", 1, [&](const inja::Arguments &args) {
     const auto component_name     = args[0]->get<std::string>();
@@ -527,6 +781,8 @@ std::pair<std::string, int> run_command(const std::string target, construction_t
     auto [component_path, package_path] = component_location.value();
     yakka::component new_component;
     if (new_component.parse_file(component_path, package_path) == yakka::yakka_status::SUCCESS) {
+      static auto &stats = get_stat_counter("json deep copy");
+      stats.increment();
       return new_component.json;
     } else {
       return nlohmann::json{};
@@ -535,67 +791,58 @@ std::pair<std::string, int> run_command(const std::string target, construction_t
 
   std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
 
-  // Note: A blueprint process is a sequence of maps
-  for (const auto &command_entry: blueprint->blueprint->process) {
-    assert(command_entry.is_object());
-
-    if (command_entry.size() != 1) {
-      spdlog::error("Command '{}' for target '{}' is malformed", command_entry.begin().key(), target);
-      return { "", -1 };
-    }
-
-    // Take the first entry in the map as the command
-    auto command                   = command_entry.begin();
-    const std::string command_name = command.key();
-    int retcode                    = 0;
+  for (const auto &step: blueprint->blueprint->steps) {
+    int retcode = 0;
 
     try {
-      if (project->project_summary["tools"].contains(command_name)) {
-        auto tool                = project->project_summary["tools"][command_name];
-        std::string command_text = "";
-
-        command_text.append(tool);
-
-        std::string arg_text = command.value().get<std::string>();
-
-        // Apply template engine
-        arg_text = try_render(inja_env, arg_text, project->project_summary);
-
-        auto [temp_output, temp_retcode] = exec(command_text, arg_text);
-        retcode                          = temp_retcode;
-
-        if (retcode != 0)
-          spdlog::error("Returned {}\n{}", retcode, temp_output);
-        if (retcode < 0)
-          return { temp_output, retcode };
-
-        captured_output = temp_output;
-        // Echo the output of the command
-        // TODO: Note this should be done by the main thread to ensure the outputs from multiple run_command instances don't overlap
-        spdlog::info(captured_output);
-      }
-      // Else check if it is a built-in command
-      else if (project->blueprint_commands.contains(command_name)) {
-        yakka::process_return test_result = project->blueprint_commands.at(command_name)(target, command.value(), captured_output, project->project_summary, inja_env);
-        captured_output                   = test_result.result;
-        retcode                           = test_result.retcode;
-      } else {
-        spdlog::error("{} tool doesn't exist", command_name);
+      switch (step.type) {
+        case yakka::blueprint::process_step::TOOL_STEP: {
+          // Apply template engine
+          const std::string arg_text = step.argument_is_template ? try_render(inja_env, step.argument.get<std::string>(), project->project_summary) : step.argument.get<std::string>();
+
+          auto [temp_output, temp_retcode] = exec(step.tool, arg_text);
+          retcode                          = temp_retcode;
+
+          if (retcode != 0)
+            spdlog::error("Returned {}\n{}", retcode, temp_output);
+          if (retcode < 0)
+            return { temp_output, retcode };
+
+          captured.text  = std::move(temp_output);
+          captured.value = nullptr;
+          // Echo the output of the command
+          // TODO: Note this should be done by the main thread to ensure the outputs from multiple run_command instances don't overlap
+          spdlog::info(captured.text);
+          break;
+        }
+        case yakka::blueprint::process_step::BUILTIN_STEP: {
+          yakka::process_return result = (*step.command)(target, step.argument, std::move(captured), project->project_summary, inja_env);
+          captured.text                = std::move(result.result);
+          captured.value               = std::move(result.value);
+          retcode                      = result.retcode;
+          break;
+        }
+        default:
+          spdlog::error("{} tool doesn't exist", step.name);
+          break;
       }
 
       if (retcode < 0)
-        return { captured_output, retcode };
+        return { std::move(captured.text), retcode };
     } catch (std::exception &e) {
-      spdlog::error("Failed to run command: '{}' as part of {}", command_name, target);
+      spdlog::error("Failed to run command: '{}' as part of {}", step.name, target);
       spdlog::error("{}", e.what());
       throw e;
     }
   }
 
+  // Tools may have rewritten the target without the cache seeing it
+  get_file_cache().invalidate(target);
+
   std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
   auto duration                                     = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
   spdlog::info("{}: {} milliseconds", target, duration);
-  return { captured_output, 0 };
+  return { std::move(captured.text), 0 };
 }
 
 std::pair<std::string, int> download_resource(const std::string url, fs::path destination)
@@ -620,16 +867,76 @@ nlohmann::json::json_pointer create_condition_pointer(const nlohmann::json condi
   return pointer;
 }
 
-bool has_data_dependency_changed(std::string data_path, const nlohmann::json left, const nlohmann::json right)
+/**
+ * @brief Replaces every occurrence of word that is not part of a larger identifier. Matches the '\b' word boundaries of std::regex.
+ *        Candidates are found by searching for the first character of word so most of the input is skipped by memchr.
+ */
+std::string replace_whole_word(std::string_view input, std::string_view word, std::string_view replacement)
+{
+  auto is_word_char = [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+
+  std::string output;
+  output.reserve(input.size());
+  size_t copied = 0;
+  for (size_t i = input.find(word.front()); i != std::string_view::npos; i = input.find(word.front(), i + 1)) {
+    if (input.compare(i, word.size(), word) != 0)
+      continue;
+    const size_t end = i + word.size();
+    if ((i > 0 && is_word_char(input[i - 1])) || (end < input.size() && is_word_char(input[end])))
+      continue;
+
+    output.append(input, copied, i - copied);
+    output.append(replacement);
+    copied = end;
+    i      = end - 1;
+  }
+  output.append(input, copied);
+  return output;
+}
+
+/**
+ * @brief Removes every leading "./" from a path, such as the "././" of paths built from a component in the current directory.
+ *        Dependencies and the tasks created for them must agree on the name, so they are all stripped this way.
+ */
+std::string_view strip_current_directory(std::string_view path)
+{
+  while (path.starts_with("./")) {
+    const auto start = path.find_first_not_of('/', 2);
+    path.remove_prefix(start == std::string_view::npos ? path.size() : start);
+  }
+  return path;
+}
+
+/**
+ * @brief Checks if the data a data dependency refers to differs between two summaries.
+ *        The summaries and the referenced subtrees are compared in place. Data tasks run for every data dependency so nothing is copied.
+ */
+bool has_data_dependency_changed(const std::string &data_path, const nlohmann::json &left, const nlohmann::json &right)
 {
   if (data_path[0] != data_dependency_identifier)
     return false;
 
   assert(data_path[1] == '/');
 
-  // std::lock_guard<std::mutex> lock(project_lock);
+  // Returns the child at a key or pointer, or null if there isn't one
+  static const nlohmann::json null_node;
+  auto find_node = [](const nlohmann::json &node, const auto &key) -> const nlohmann::json & {
+    if constexpr (std::is_same_v<std::decay_t<decltype(key)>, nlohmann::json::json_pointer>) {
+      return node.contains(key) ? node.at(key) : null_node;
+    } else {
+      if (!node.is_object())
+        return null_node;
+      const auto i = node.find(key);
+      return i != node.end() ? *i : null_node;
+    }
+  };
+
   try {
-    if (left.is_null() || left["components"].is_null())
+    const auto &left_components  = find_node(left, "components");
+    const auto &right_components = find_node(right, "components");
+    if (left_components.is_null())
       return true;
 
     // Check for wildcard or component name
@@ -639,29 +946,21 @@ bool has_data_dependency_changed(std::string data_path, const nlohmann::json lef
         return false;
       }
 
-      data_path = data_path.substr(3);
-      nlohmann::json::json_pointer pointer{ data_path };
-      for (const auto &[c_key, c_value]: right["components"].items()) {
-        std::string component_name = c_key;
-        if (!left["components"].contains(component_name))
+      const nlohmann::json::json_pointer pointer{ data_path.substr(3) };
+      for (const auto &[component_name, right_component]: right_components.items()) {
+        if (!left_components.contains(component_name))
           return true;
-        auto a = left["components"][component_name].contains(pointer) ? left["components"][component_name][pointer] : nlohmann::json{};
-        auto b = right["components"][component_name].contains(pointer) ? right["components"][component_name][pointer] : nlohmann::json{};
-        if (a != b) {
+        if (find_node(left_components[component_name], pointer) != find_node(right_component, pointer))
           return true;
-        }
       }
     } else {
-      std::string component_name = data_path.substr(2, data_path.find_first_of('/', 2) - 2);
-      data_path                  = data_path.substr(data_path.find_first_of('/', 2));
-      nlohmann::json::json_pointer pointer{ data_path };
-      if (!left["components"].contains(component_name))
+      const auto slash                 = data_path.find_first_of('/', 2);
+      const std::string component_name = data_path.substr(2, slash - 2);
+      const nlohmann::json::json_pointer pointer{ data_path.substr(slash) };
+      if (!left_components.contains(component_name))
         return true;
-      auto a = left["components"][component_name].contains(pointer) ? left["components"][component_name][pointer] : nlohmann::json{};
-      auto b = right["components"][component_name].contains(pointer) ? right["components"][component_name][pointer] : nlohmann::json{};
-      if (a != b) {
+      if (find_node(left_components[component_name], pointer) != find_node(find_node(right_components, component_name), pointer))
         return true;
-      }
     }
     return false;
   } catch (const std::exception &e) {
@@ -670,4 +969,21 @@ bool has_data_dependency_changed(std::string data_path, const nlohmann::json lef
   }
 }
 
+/**
+ * @brief fs::exists() and fs::last_write_time() with a stats counter. Used on the task hot path.
+ */
+bool timed_exists(const fs::path &path)
+{
+  static auto &stats = get_stat_counter("fs exists");
+  scoped_stat_timer timer(stats);
+  return fs::exists(path);
+}
+
+fs::file_time_type timed_last_write_time(const fs::path &path)
+{
+  static auto &stats = get_stat_counter("fs last_write_time");
+  scoped_stat_timer timer(stats);
+  return fs::last_write_time(path);
+}
+
 } // namespace yakka
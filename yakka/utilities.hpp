@@ -3,7 +3,11 @@
 #include "yaml-cpp/yaml.h"
 #include "inja.hpp"
 #include <string>
+#include <string_view>
 #include <unordered_set>
+#include <unordered_map>
+#include <shared_mutex>
+#include <memory>
 #include <filesystem>
 
 namespace fs = std::filesystem;
@@ -25,12 +29,65 @@ std::string generate_project_name(const component_list_t &components, const feat
 std::vector<std::string> parse_gcc_dependency_file(const std::string &filename);
 std::string component_dotname_to_id(const std::string dotname);
 fs::path get_yakka_shared_home();
+std::string render_template(inja::Environment &env, const std::string &input, const nlohmann::json &data);
 std::string try_render(inja::Environment &env, const std::string &input, const nlohmann::json &data);
 std::string try_render_file(inja::Environment &env, const std::string &filename, const nlohmann::json &data);
 std::pair<std::string, int> download_resource(const std::string url, fs::path destination);
 nlohmann::json::json_pointer create_condition_pointer(const nlohmann::json condition);
-bool has_data_dependency_changed(std::string data_path, const nlohmann::json left, const nlohmann::json right);
+bool has_data_dependency_changed(const std::string &data_path, const nlohmann::json &left, const nlohmann::json &right);
 void add_common_template_commands(inja::Environment &inja_env);
+bool has_template_markup(const std::string &input);
+std::string replace_whole_word(std::string_view input, std::string_view word, std::string_view replacement);
+std::string_view strip_current_directory(std::string_view path);
+bool timed_exists(const fs::path &path);
+fs::file_time_type timed_last_write_time(const fs::path &path);
+
+/**
+ * @brief Memo of 'aggregate' template results for a project summary, keyed by path.
+ *        The components are only walked the first time a path is requested. Strings containing template markup are rendered on every
+ *        lookup as the result depends on the caller's environment. The cache must be cleared when the summary components or data change.
+ */
+class aggregate_cache {
+public:
+  nlohmann::json aggregate(const nlohmann::json &summary, const std::string &path, const std::function<std::string(const std::string &)> &render);
+  void clear();
+
+private:
+  struct entry {
+    nlohmann::json value;
+    std::vector<size_t> render_indices; // Elements of value that must be rendered
+  };
+  static entry collect(const nlohmann::json &summary, const std::string &path);
+
+  std::shared_mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<const entry>> entries;
+};
+
+/**
+ * @brief Run-wide cache of Jinja template files compiled by a shared inja environment, keyed by path and modification time.
+ *        Jinja whitespace control, comments, 'elif', the 'loop' variables and the removal of a single trailing newline are translated to inja
+ *        so the output matches Jinja. Filters, macros and tests are not translated and fail to compile.
+ *        Templates are rendered concurrently. The environment only has the common template commands, as callbacks are bound when a
+ *        template is compiled, and it is only changed while compiling, which holds the lock exclusively.
+ */
+class jinja_template_cache {
+public:
+  jinja_template_cache();
+  std::string render(const std::string &filename, const nlohmann::json &data);
+
+private:
+  struct entry {
+    fs::file_time_type timestamp;
+    std::shared_ptr<const inja::Template> compiled;
+  };
+
+  std::shared_mutex mutex;
+  inja::Environment environment;
+  std::unordered_map<std::string, entry> entries;
+};
+
+// Returns the cache shared by everything in this run
+jinja_template_cache &get_jinja_template_cache();
 
 template <class CharContainer> static size_t get_file_contents(const std::string &filename, CharContainer *container)
 {
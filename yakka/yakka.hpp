@@ -41,8 +41,24 @@ const auto async_launch_option           = std::launch::deferred;
 struct process_return {
   std::string result;
   int retcode;
+  nlohmann::json value = nullptr;
 };
 
+// Output handed from one blueprint process step to the next. It is move-only so tool output is never copied between steps.
+// 'value' optionally holds the output as structured data, in which case 'text' is left empty until a step needs it.
+struct process_data {
+  std::string text;
+  nlohmann::json value;
+
+  process_data()                                = default;
+  process_data(process_data &&)                 = default;
+  process_data &operator=(process_data &&)      = default;
+  process_data(const process_data &)            = delete;
+  process_data &operator=(const process_data &) = delete;
+};
+
+typedef std::function<yakka::process_return(const std::string &, const nlohmann::json &, yakka::process_data &&, const nlohmann::json &, inja::Environment &)> blueprint_command;
+
 struct project_description {
   std::vector<std::string> components;
   std::vector<std::string> features;
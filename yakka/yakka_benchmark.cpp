@@ -0,0 +1,319 @@
+// Times each yakka phase as a library call against generated workspaces of increasing size.
+// Usage: yakka_benchmark -c 10,100,1000 -s 10 -d 0.1 --slc -o results.json
+// Each workspace has the given number of components with sources, supports, choices and replacements at the given density,
+// an optional tree of SLC components, and a toolchain whose blueprints follow tools/toolchains/gcc/gcc.bob with processes that only render templates.
+#include "yakka.hpp"
+#include "yakka_workspace.hpp"
+#include "yakka_project.hpp"
+#include "cxxopts.hpp"
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/basic_file_sink.h"
+#include "taskflow.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct workspace_parameters {
+  size_t components;
+  size_t sources;
+  double density;
+  bool slc;
+  unsigned int seed;
+};
+
+// Modelled on tools/toolchains/gcc/gcc.bob. Processes only render their command line so execution measures yakka rather than a compiler.
+static const char *toolchain_component = R"(name: Benchmark toolchain
+
+flags:
+  c:
+    global:
+      - -Os
+      - -MD
+  ld:
+    global:
+      - -Os
+
+blueprints:
+  link:
+    depends:
+      - '{{project_output}}/{{project_name}}.elf'
+
+  '{{project_output}}/{{project_name}}.elf':
+    depends:
+      - '[{% for name, component in components %}{%if existsIn(component,"sources") %}{% for source in component.sources %}{{project_output}}/components/{{name}}/{{source}}.o, {% endfor %}{% endif %}{% endfor %}]'
+      - '{{project_output}}/{{project_name}}.global_ld_options'
+    process:
+      - inja: "gcc @{{project_output}}/{{project_name}}.global_ld_options -o {{$(0)}}"
+
+  object_files:
+    regex: .+/components/([^/]*)/(.*)\.(cpp|c)\.o
+    depends:
+      - '{{project_output}}/components/{{$(1)}}/{{$(1)}}.{{$(3)}}_options'
+      - '{{at(components, $(1)).directory}}/{{$(2)}}.{{$(3)}}'
+      - '{{project_output}}/{{project_name}}.global_{{$(3)}}_options'
+    process:
+      - inja: "gcc -c @{{project_output}}/{{project_name}}.global_{{$(3)}}_options @{{project_output}}/components/{{$(1)}}/{{$(1)}}.{{$(3)}}_options -o {{$(0)}} {{at(components, $(1)).directory}}/{{$(2)}}.{{$(3)}}"
+
+  '{{project_output}}/{{project_name}}.global_ld_options':
+    depends:
+      - data:
+          - '/*/flags/ld'
+    process:
+      - inja: "{% for name,component in components %}{% for flag in component.flags.ld.global %}{{flag}} {% endfor %}{%endfor%}"
+
+  global_compiler_options:
+    regex: '{{project_output}}/{{project_name}}.global_(cpp|c)_options'
+    depends:
+      - data:
+          - '/*/flags/{{$(1)}}/global'
+          - '/*/includes/global'
+          - '/*/defines/global'
+    process:
+      - inja: "{% for name,component in components %}
+        {% if existsIn(component, \"flags\") and existsIn(component.flags, $(1)) %}{% for flag in at(component.flags, $(1)).global %}{{flag}} {% endfor %}{%endif%}
+        {%- for include in component.includes.global %}-I{{component.directory}}/{{include}} {% endfor %}
+        {%- for define in component.defines.global %}-D{{define}} {% endfor %}
+        {%endfor%}"
+
+  compiler_option_files:
+    regex: '.+/components/([^/]*)/\1\.(cpp|c)_options'
+    depends:
+      - data:
+          - '/{{$(1)}}/flags/{{$(2)}}/local'
+          - '/{{$(1)}}/includes/local'
+          - '/{{$(1)}}/defines/local'
+    process:
+      - inja: "{% set component=at(components,$(1)) %}
+        {% if existsIn(component, \"flags\")%}{% for flag in at(component.flags, $(2)).local %}{{flag}} {% endfor %}{%endif%}
+        {% for include in component.includes.local %}-I{{component.directory}}/{{include}} {% endfor %}
+        {% for define in component.defines.local %}-D{{define}} {% endfor %}"
+)";
+
+static void write_file(const fs::path &path, const std::string &content)
+{
+  fs::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios_base::binary);
+  file << content;
+}
+
+static void write_component(const fs::path &directory, const std::string &name, size_t index, size_t sources, const std::vector<size_t> &dependencies, bool has_supports, bool has_choice, size_t feature_count)
+{
+  std::ostringstream yakka;
+  yakka << "name: " << name << "\n";
+  yakka << "sources:\n";
+  for (size_t s = 0; s < sources; ++s) {
+    yakka << "  - s" << s << ".c\n";
+    write_file(directory / ("s" + std::to_string(s) + ".c"), "int " + name + "_s" + std::to_string(s) + ";\n");
+  }
+  yakka << "includes:\n  global:\n    - include\n  local:\n    - src\n";
+  yakka << "defines:\n  global:\n    - " << name << "_PRESENT\n  local:\n    - " << name << "_LOCAL\n";
+  yakka << "flags:\n  c:\n    local:\n      - -DINDEX=" << index << "\n";
+  if (!dependencies.empty()) {
+    yakka << "requires:\n  components:\n";
+    for (const auto r: dependencies)
+      yakka << "    - c" << r << "\n";
+  }
+  if (has_supports) {
+    yakka << "supports:\n  features:\n    feature" << index % feature_count << ":\n      defines:\n        global:\n          - " << name << "_WITH_FEATURE\n";
+    if (!dependencies.empty())
+      yakka << "  components:\n    c" << dependencies.front() << ":\n      defines:\n        local:\n          - " << name << "_WITH_C" << dependencies.front() << "\n";
+  }
+  if (has_choice) {
+    yakka << "choices:\n  choice" << index << ":\n    description: Generated choice\n    features:\n      - choice" << index << "_a\n      - choice" << index << "_b\n    default:\n      feature: choice" << index << "_a\n";
+  }
+  write_file(directory / (name + ".yakka"), yakka.str());
+}
+
+/**
+ * @brief Generates a workspace for the parameters. Every component is required by 'app'. Components also require a few later components,
+ *        and some are replaced by an '_alt' component so replacement retraction is exercised.
+ */
+static void generate_workspace(const fs::path &root, const workspace_parameters &parameters)
+{
+  fs::remove_all(root);
+  std::mt19937 random(parameters.seed);
+  std::bernoulli_distribution chance(parameters.density);
+  const size_t feature_count = std::max<size_t>(1, parameters.components * parameters.density);
+
+  std::ostringstream app;
+  app << "name: app\nrequires:\n  components:\n    - benchmark_toolchain\n";
+  for (size_t i = 0; i < parameters.components; ++i) {
+    std::vector<size_t> dependencies;
+    if (i + 1 < parameters.components)
+      for (int r = 0; r < 2; ++r)
+        dependencies.push_back(std::uniform_int_distribution<size_t>(i + 1, parameters.components - 1)(random));
+    if (dependencies.size() == 2 && dependencies[0] == dependencies[1])
+      dependencies.pop_back();
+
+    const auto name = "c" + std::to_string(i);
+    write_component(root / "components" / name, name, i, parameters.sources, dependencies, chance(random), chance(random), feature_count);
+    app << "    - " << name << "\n";
+
+    if (chance(random)) {
+      const auto alt_name = name + "_alt";
+      write_component(root / "components" / alt_name, alt_name, i, 1, {}, false, false, feature_count);
+      const auto alt_path = root / "components" / alt_name / (alt_name + ".yakka");
+      std::ofstream(alt_path, std::ios_base::app | std::ios_base::binary) << "replaces:\n  component: " << name << "\n";
+      app << "    - " << alt_name << "\n";
+    }
+  }
+  if (parameters.slc)
+    app << "    - slc0\n";
+  app << "  features:\n";
+  for (size_t f = 0; f < feature_count; ++f)
+    app << "    - feature" << f << "\n";
+  write_file(root / "components" / "app.yakka", app.str());
+  write_file(root / "components" / "benchmark_toolchain.yakka", toolchain_component);
+
+  // SLC components form a binary tree of feature requirements. Some features have two providers separated by a condition.
+  if (parameters.slc)
+    for (size_t i = 0; i < parameters.components; ++i) {
+      std::ostringstream slcc;
+      slcc << "id: slc" << i << "\nlabel: slc" << i << "\ndescription: Generated\ncategory: benchmark\nquality: production\npackage: benchmark\n";
+      slcc << "provides:\n  - name: slc_feature" << i << "\n";
+      if (chance(random))
+        slcc << "  - name: slc_target\n";
+      if (2 * i + 1 < parameters.components) {
+        slcc << "requires:\n  - name: slc_feature" << 2 * i + 1 << "\n";
+        if (2 * i + 2 < parameters.components)
+          slcc << "  - name: slc_feature" << 2 * i + 2 << "\n";
+      }
+      write_file(root / "components" / "slc" / ("slc" + std::to_string(i) + ".slcc"), slcc.str());
+    }
+}
+
+template<typename F> static double time_ms(F f)
+{
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static nlohmann::json run_phases(const fs::path &root)
+{
+  const auto original_directory = fs::current_path();
+  fs::current_path(root);
+
+  nlohmann::json phases;
+  yakka::workspace workspace;
+  phases["database_scan"] = time_ms([&]() {
+    workspace.init(".");
+  });
+
+  yakka::project project("benchmark", workspace);
+  project.commands = { "link" };
+  project.init_project({ "app" }, {});
+
+  phases["evaluate_dependencies"] = time_ms([&]() {
+    project.evaluate_dependencies();
+    project.evaluate_choices();
+  });
+  phases["process_slc_rules"] = time_ms([&]() {
+    project.process_slc_rules();
+  });
+  phases["generate_project_summary"] = time_ms([&]() {
+    project.generate_project_summary();
+    project.save_summary();
+  });
+  phases["validate_schema"] = time_ms([&]() {
+    project.validate_schema();
+  });
+  phases["process_blueprints"] = time_ms([&]() {
+    project.process_blueprints();
+  });
+  phases["generate_target_database"] = time_ms([&]() {
+    project.generate_target_database();
+  });
+  phases["compile_blueprints"] = time_ms([&]() {
+    project.load_common_commands();
+    project.compile_blueprints();
+  });
+
+  tf::Executor executor(std::min(32U, std::max(1U, std::thread::hardware_concurrency())));
+  std::atomic<size_t> completed         = 0;
+  project.todo_task_groups["Processing"] = std::make_shared<yakka::task_group>("Processing");
+  project.task_complete_handler          = [&](std::shared_ptr<yakka::task_group> group) {
+    ++completed;
+  };
+  phases["graph_construction"] = time_ms([&]() {
+    auto finish = project.taskflow.emplace([]() {
+    });
+    for (auto &c: project.commands)
+      project.create_tasks(c, finish);
+  });
+  phases["execution"] = time_ms([&]() {
+    executor.run(project.taskflow).wait();
+  });
+
+  nlohmann::json run;
+  run["project_components"] = project.components.size();
+  run["targets"]            = project.target_database.targets.size();
+  run["tasks"]              = project.todo_list.size();
+  run["completed_tasks"]    = completed.load();
+  run["valid"]              = project.current_state == yakka::project::state::PROJECT_VALID && !project.abort_build;
+  run["phases_ms"]          = phases;
+
+  fs::current_path(original_directory);
+  return run;
+}
+
+int main(int argc, char **argv)
+{
+  cxxopts::Options options("yakka_benchmark", "Times each yakka phase against generated workspaces");
+  // clang-format off
+  options.add_options()("h,help", "Print usage")
+                       ("c,components", "Component counts to benchmark", cxxopts::value<std::vector<size_t>>()->default_value("10,100,1000"))
+                       ("s,sources", "Sources per component", cxxopts::value<size_t>()->default_value("10"))
+                       ("d,density", "Fraction of components with supports, choices and replacements", cxxopts::value<double>()->default_value("0.1"))
+                       ("slc", "Add a tree of SLC components", cxxopts::value<bool>()->default_value("false"))
+                       ("seed", "Random seed", cxxopts::value<unsigned int>()->default_value("1"))
+                       ("w,workspace", "Directory for the generated workspaces", cxxopts::value<std::string>()->default_value("benchmark_workspace"))
+                       ("o,output", "File for the JSON results. Printed if not given", cxxopts::value<std::string>()->default_value(""));
+  // clang-format on
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  const fs::path workspace_root = fs::absolute(result["workspace"].as<std::string>());
+  fs::create_directories(workspace_root);
+
+  // Yakka logs to the default logger and 'echo' uses the console logger. Both go to a file so they don't disturb the results.
+  auto log = spdlog::basic_logger_mt("yakkalog", (workspace_root / "yakka_benchmark.log").string(), true);
+  spdlog::set_default_logger(log);
+  spdlog::basic_logger_mt("console", (workspace_root / "yakka_benchmark_console.log").string(), true);
+
+  nlohmann::json results;
+  results["parameters"]["sources"] = result["sources"].as<size_t>();
+  results["parameters"]["density"] = result["density"].as<double>();
+  results["parameters"]["slc"]     = result["slc"].as<bool>();
+  results["parameters"]["seed"]    = result["seed"].as<unsigned int>();
+  results["runs"]                  = nlohmann::json::array();
+
+  for (const auto count: result["components"].as<std::vector<size_t>>()) {
+    const workspace_parameters parameters{ count, result["sources"].as<size_t>(), result["density"].as<double>(), result["slc"].as<bool>(), result["seed"].as<unsigned int>() };
+    const auto root = workspace_root / ("components_" + std::to_string(count));
+    generate_workspace(root, parameters);
+
+    auto run          = run_phases(root);
+    run["components"] = count;
+    results["runs"].push_back(run);
+    std::cerr << "Completed " << count << " components\n";
+  }
+
+  const auto output = result["output"].as<std::string>();
+  if (output.empty()) {
+    std::cout << results.dump(2) << "\n";
+  } else {
+    std::ofstream output_file(output);
+    output_file << results.dump(2) << "\n";
+  }
+  return 0;
+}
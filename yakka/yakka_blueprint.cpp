@@ -1,4 +1,6 @@
 #include "yakka_blueprint.hpp"
+#include "utilities.hpp"
+#include "spdlog/spdlog.h"
 #include <iostream>
 
 namespace yakka {
@@ -27,13 +29,32 @@ blueprint::blueprint(const std::string &target, const nlohmann::json &blueprint,
             this->dependencies.push_back({ dependency::DATA_DEPENDENCY, d["data"].get<std::string>() });
         } else if (d.contains("dependency_file")) {
           this->dependencies.push_back({ dependency::DEPENDENCY_FILE_DEPENDENCY, d["dependency_file"].get<std::string>() });
+        } else if (d.contains("list")) {
+          this->dependencies.push_back({ dependency::LIST_DEPENDENCY, d["list"].get<std::string>() });
         }
       }
     }
 
-  if (blueprint.contains("process"))
+  if (blueprint.contains("process")) {
     process = blueprint["process"];
 
+    // Note: A blueprint process is a sequence of maps
+    for (const auto &command_entry: process) {
+      if (!command_entry.is_object() || command_entry.size() != 1) {
+        errors.push_back("Command '" + command_entry.dump() + "' is malformed");
+        continue;
+      }
+
+      // Take the first entry in the map as the command
+      auto command = command_entry.begin();
+      process_step step;
+      step.name                 = command.key();
+      step.argument             = command.value();
+      step.argument_is_template = step.argument.is_string() && has_template_markup(step.argument.get_ref<const std::string &>());
+      steps.push_back(std::move(step));
+    }
+  }
+
   if (blueprint.contains("group"))
     this->task_group = blueprint["group"].get<std::string>();
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "yakka.hpp"
 #include "taskflow.hpp"
 #include "json.hpp"
 #include <future>
@@ -16,14 +17,29 @@ namespace yakka {
 
 struct blueprint {
   struct dependency {
-    enum dependency_type { DEFAULT_DEPENDENCY, DATA_DEPENDENCY, DEPENDENCY_FILE_DEPENDENCY } type;
+    enum dependency_type { DEFAULT_DEPENDENCY, DATA_DEPENDENCY, DEPENDENCY_FILE_DEPENDENCY, LIST_DEPENDENCY } type;
     std::string name;
   };
   std::string target;
   std::optional<std::string> regex;
   std::vector<std::string> requirements;
+  bool requirements_loaded = false; // The components named in requirements have been added to the project
+  // A process step split into its command and argument when the blueprint is loaded. The command is resolved by project::compile_blueprint.
+  // Template arguments are not parsed ahead of time. inja binds callbacks when a template is parsed, and the callbacks of run_command refer
+  // to the state of the target being built, so they are parsed by the environment run_command creates for each target.
+  struct process_step {
+    enum step_type { UNRESOLVED_STEP, TOOL_STEP, BUILTIN_STEP } type = UNRESOLVED_STEP;
+    std::string name;
+    nlohmann::json argument;
+    bool argument_is_template        = false;   // String argument that contains template markup
+    std::string tool;                           // Command line of a TOOL_STEP
+    const blueprint_command *command = nullptr; // Function of a BUILTIN_STEP
+  };
   std::vector<dependency> dependencies; // Unprocessed dependencies. Raw values as found in the YAML.
   nlohmann::json process;
+  std::vector<process_step> steps;
+  std::vector<std::string> errors; // Malformed process steps and unknown commands. Reported by project::compile_blueprints before building.
+  bool compiled = false;           // The process steps have been resolved by project::compile_blueprint
   std::string parent_path;
   std::string task_group;
 
@@ -1,7 +1,9 @@
 #include "yakka.hpp"
 #include "yakka_workspace.hpp"
 #include "yakka_project.hpp"
+#include "yakka_server.hpp"
 #include "utilities.hpp"
+#include "yakka_stats.hpp"
 #include "cxxopts.hpp"
 #include "subprocess.hpp"
 #include "spdlog/spdlog.h"
@@ -18,6 +20,10 @@
 #include <chrono>
 #include <future>
 #include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 using namespace indicators;
 using namespace std::chrono_literals;
@@ -36,6 +42,18 @@ int main(int argc, char **argv)
 {
   auto yakka_start_time = fs::file_time_type::clock::now();
 
+  // Hand the build to a running server if requested
+  const auto server_flag = std::find_if(argv + 1, argv + argc, [](const char *a) { return std::string_view(a) == "--server"; });
+  if (server_flag != argv + argc) {
+    std::vector<std::string> arguments;
+    for (auto a = argv + 1; a != argv + argc; ++a)
+      if (a != server_flag)
+        arguments.push_back(*a);
+    if (auto result = yakka::run_with_server(arguments))
+      return result.value();
+    std::cout << "No yakka server is running in this workspace. Building locally.\n";
+  }
+
   // Setup logging
   std::error_code error_code;
   fs::remove("yakka.log", error_code);
@@ -65,6 +83,7 @@ int main(int argc, char **argv)
   // Create a workspace
   yakka::workspace workspace;
   workspace.init(".");
+  yakka::record_stat_phase("workspace");
 
   cxxopts::Options options("yakka", "Yakka the embedded builder. Ver " + yakka_version.str());
   options.allow_unrecognised_options();
@@ -80,7 +99,9 @@ int main(int argc, char **argv)
                        ("d,data", "Additional data", cxxopts::value<std::string>())
                        ("no-slcc", "Ignore SLC files", cxxopts::value<bool>()->default_value("false"))
                        ("no-yakka", "Ignore Yakka files", cxxopts::value<bool>()->default_value("false"))
-                       ("action", "Select from 'register', 'list', 'update', 'git', 'remove', 'fetch' or a command", cxxopts::value<std::string>());
+                       ("server", "Run the command on the server started with 'yakka serve'", cxxopts::value<bool>()->default_value("false"))
+                       ("stats", "Print operation counts, timings and peak memory at the end of the run. Use --stats=json for JSON", cxxopts::value<std::string>()->default_value("")->implicit_value("text"))
+                       ("action", "Select from 'register', 'list', 'update', 'git', 'remove', 'fetch', 'serve' or a command", cxxopts::value<std::string>());
   // clang-format on
 
   options.parse_positional({ "action" });
@@ -186,6 +207,9 @@ int main(int argc, char **argv)
     // Fetch the components
     download_unknown_components(workspace, project);
     return 0;
+  } else if (action == "serve") {
+    yakka::server server(workspace);
+    return server.run();
   } else if (action.back() != '!') {
     std::cout << "Must provide an action or a command (commands end with !)\n";
     return 0;
@@ -260,7 +284,11 @@ int main(int argc, char **argv)
     }
   }
 
-  if (!result["no-eval"].as<bool>()) {
+  // A project resolved by an earlier run with the same inputs is restored instead of evaluated
+  bool resolved_from_snapshot = false;
+  if (!result["no-eval"].as<bool>() && project.load_resolution_snapshot()) {
+    resolved_from_snapshot = true;
+  } else if (!result["no-eval"].as<bool>()) {
     evaluate_project_dependencies(workspace, project);
 
     if (!project.unknown_components.empty()) {
@@ -308,8 +336,9 @@ int main(int argc, char **argv)
     }
   }
 
-  if (result["no-slcc"].count() == 0)
+  if (!resolved_from_snapshot && result["no-slcc"].count() == 0)
     project.process_slc_rules();
+  yakka::record_stat_phase("evaluation");
 
   // Project evaluation is complete
 
@@ -319,17 +348,22 @@ int main(int argc, char **argv)
     spdlog::info("- {}", f);
 
   // Generate and save the summary
-  project.generate_project_summary();
-  project.save_summary();
+  if (!resolved_from_snapshot) {
+    project.generate_project_summary();
+    project.save_summary();
+  }
 
-  auto t1 = std::chrono::high_resolution_clock::now();
-  project.validate_schema();
-  auto t2       = std::chrono::high_resolution_clock::now();
-  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+  auto t1           = std::chrono::high_resolution_clock::now();
+  bool schema_valid = resolved_from_snapshot || project.validate_schema();
+  auto t2           = std::chrono::high_resolution_clock::now();
+  auto duration     = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
   spdlog::info("{}ms to validate schemas", duration);
 
   if (project.current_state != yakka::project::state::PROJECT_VALID)
     exit(-1);
+  if (!resolved_from_snapshot && !result["no-eval"].as<bool>() && schema_valid)
+    project.save_resolution_snapshot();
+  yakka::record_stat_phase("summary");
 
   // Insert additional command line data before processing blueprints
   if (result["data"].count() != 0) {
@@ -339,41 +373,14 @@ int main(int argc, char **argv)
     nlohmann::json json_data   = yaml_data.as<nlohmann::json>();
     spdlog::info("Additional data: {}", json_data.dump());
     yakka::json_node_merge(project.project_summary["data"], json_data);
+    project.aggregates.clear();
   }
 
   t1 = std::chrono::high_resolution_clock::now();
   project.process_blueprints();
 
-  // Ensure all the commands have a blueprint
-  spdlog::info("Checking for missing blueprints");
-  for (const auto &c: project.commands) {
-    if (project.blueprint_database.blueprints.contains(c))
-      continue;
-
-    // Find a component that has that blueprint
-    auto result = workspace.find_blueprint(c);
-    if (result) {
-      const auto blueprint_options = result.value();
-      if (blueprint_options.size() == 1) {
-        const auto &component_name = blueprint_options[0].get<std::string>();
-        auto component_paths       = workspace.find_component(component_name);
-        if (component_paths) {
-          auto [component_path, db_path] = component_paths.value();
-          spdlog::info("Found a blueprint for {}: {}", c, component_path.string());
-          project.add_additional_tool(component_path);
-        } else {
-          spdlog::error("Could not find component for blueprint: {}", c);
-        }
-      } else {
-        spdlog::error("Multiple options for missing blueprint {}", c);
-        for (const auto &o: blueprint_options)
-          spdlog::error("- {}", o.get<std::string>());
-        return -1;
-      }
-    } else {
-      spdlog::info("Did not find a blueprint for {}", c);
-    }
-  }
+  if (!project.add_missing_blueprints())
+    return -1;
 
   project.generate_target_database();
   t2 = std::chrono::high_resolution_clock::now();
@@ -381,12 +388,20 @@ int main(int argc, char **argv)
   duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
   spdlog::info("{}ms to process blueprints", duration);
   project.load_common_commands();
+  if (!project.compile_blueprints())
+    return -1;
+  yakka::record_stat_phase("blueprints");
 
   run_taskflow(project);
+  yakka::record_stat_phase("execution");
 
   auto yakka_end_time = fs::file_time_type::clock::now();
   std::cout << "Complete in " << std::chrono::duration_cast<std::chrono::milliseconds>(yakka_end_time - yakka_start_time).count() << " milliseconds" << std::endl;
 
+  const auto stats_format = result["stats"].as<std::string>();
+  if (!stats_format.empty())
+    yakka::print_stats(stats_format == "json");
+
   spdlog::shutdown();
   show_console_cursor(true);
 
@@ -444,6 +459,11 @@ void run_taskflow(yakka::project &project)
   task_progress_ui.print_progress();
 }
 
+/**
+ * @brief Fetches the unknown components of a project from the registries.
+ *        Fetches run concurrently up to a fixed limit. As each fetch completes its .yakka files are parsed on the fetching thread
+ *        and the components they require are queued immediately rather than waiting for the project to be re-evaluated.
+ */
 static void download_unknown_components(yakka::workspace &workspace, yakka::project &project)
 {
   auto t1 = std::chrono::high_resolution_clock::now();
@@ -456,32 +476,72 @@ static void download_unknown_components(yakka::workspace &workspace, yakka::proj
     DynamicProgress<ProgressBar> fetch_progress_ui;
     std::vector<std::shared_ptr<ProgressBar>> fetch_progress_bars;
 
+    // Completed fetches are handed back to this thread with the components they require
+    struct fetch_result {
+      std::string name;
+      fs::path path;
+      std::vector<std::string> required_components;
+    };
+    std::mutex fetch_mutex;
+    std::condition_variable fetch_complete;
+    std::deque<fetch_result> completed_fetches;
+
+    const size_t max_concurrent_fetches = std::max(4u, std::thread::hardware_concurrency());
     std::map<std::string, std::future<fs::path>> fetch_list;
-    do {
-      // Ask the workspace to fetch them
-      for (const auto &i: project.unknown_components) {
-        if (fetch_list.find(i) != fetch_list.end())
-          continue;
-
-        // Check if component is in the registry
-        auto node = workspace.find_registry_component(i);
-        if (node) {
-          std::shared_ptr<ProgressBar> new_progress_bar = std::make_shared<ProgressBar>(option::BarWidth{ 50 }, option::ShowPercentage{ true }, option::PrefixText{ "Fetching " + i + " " }, option::SavedStartTime{ true });
-          fetch_progress_bars.push_back(new_progress_bar);
-          size_t id = fetch_progress_ui.push_back(*new_progress_bar);
-          fetch_progress_ui.print_progress();
-          auto result = workspace.fetch_component(i, *node, [&fetch_progress_ui, id](std::string prefix, size_t number) {
+    std::deque<std::pair<std::string, YAML::Node>> pending_fetches;
+    std::unordered_set<std::string> requested_fetches;
+
+    // Queue a fetch for a component that is in a registry and not already available
+    auto request_fetch = [&](const std::string &name) {
+      if (!requested_fetches.insert(name).second)
+        return;
+      if (project.required_components.contains(name) || !workspace.local_database.get_component(name, project.component_flags).empty() || !workspace.shared_database.get_component(name, project.component_flags).empty())
+        return;
+      auto node = workspace.find_registry_component(name);
+      if (node)
+        pending_fetches.push_back({ name, *node });
+    };
+
+    auto start_fetches = [&]() {
+      while (fetch_list.size() < max_concurrent_fetches && !pending_fetches.empty()) {
+        const auto [name, node] = pending_fetches.front();
+        pending_fetches.pop_front();
+
+        std::shared_ptr<ProgressBar> new_progress_bar = std::make_shared<ProgressBar>(option::BarWidth{ 50 }, option::ShowPercentage{ true }, option::PrefixText{ "Fetching " + name + " " }, option::SavedStartTime{ true });
+        fetch_progress_bars.push_back(new_progress_bar);
+        size_t id = fetch_progress_ui.push_back(*new_progress_bar);
+        fetch_progress_ui.print_progress();
+        auto result = workspace.fetch_component(
+          name,
+          node,
+          [&fetch_progress_ui, id](std::string prefix, size_t number) {
             fetch_progress_ui[id].set_option(option::PrefixText{ prefix });
             if (number >= 100) {
               fetch_progress_ui[id].set_progress(100);
               fetch_progress_ui[id].mark_as_completed();
             } else
               fetch_progress_ui[id].set_progress(number);
+          },
+          [&, name](const fs::path &path) {
+            fetch_result completed{ name, path, {} };
+            if (!path.empty())
+              completed.required_components = yakka::workspace::find_required_components(path);
+            {
+              std::lock_guard<std::mutex> lock(fetch_mutex);
+              completed_fetches.push_back(std::move(completed));
+            }
+            fetch_complete.notify_one();
           });
-          if (result.valid())
-            fetch_list.insert({ i, std::move(result) });
-        }
+        if (result.valid())
+          fetch_list.insert({ name, std::move(result) });
       }
+    };
+
+    do {
+      // Ask the workspace to fetch them
+      for (const auto &i: project.unknown_components)
+        request_fetch(i);
+      start_fetches();
 
       // Check if we haven't been able to fetch any of the unknown components
       if (fetch_list.empty()) {
@@ -491,33 +551,42 @@ static void download_unknown_components(yakka::workspace &workspace, yakka::proj
         exit(0);
       }
 
-      // Wait for one of the components to be complete
-      decltype(fetch_list)::iterator completed_fetch;
-      do {
-        completed_fetch = std::find_if(fetch_list.begin(), fetch_list.end(), [](auto &fetch_item) {
-          return fetch_item.second.wait_for(100ms) == std::future_status::ready;
+      // Process fetches as they complete, starting fetches for the components they require
+      while (!fetch_list.empty()) {
+        std::unique_lock<std::mutex> lock(fetch_mutex);
+        fetch_complete.wait(lock, [&]() {
+          return !completed_fetches.empty();
         });
-      } while (completed_fetch == fetch_list.end());
-
-      auto new_component_path = completed_fetch->second.get();
-
-      // Check if the fetch worked
-      if (new_component_path.empty()) {
-        spdlog::error("Failed to fetch {}", completed_fetch->first);
-        project.unknown_components.erase(completed_fetch->first);
-        fetch_list.erase(completed_fetch);
-        continue;
-      }
-
-      // Update the component database
-      if (new_component_path.string().starts_with(workspace.shared_components_path.string())) {
-        spdlog::info("Scanning for new component in shared database");
-        workspace.shared_database.scan_for_components(new_component_path);
-        workspace.shared_database.save();
-      } else {
-        spdlog::info("Scanning for new component in local database");
-        workspace.local_database.scan_for_components(new_component_path);
-        workspace.shared_database.save();
+        auto completed = std::move(completed_fetches);
+        completed_fetches.clear();
+        lock.unlock();
+
+        for (const auto &f: completed) {
+          fetch_list.erase(f.name);
+
+          // Check if the fetch worked
+          if (f.path.empty()) {
+            spdlog::error("Failed to fetch {}", f.name);
+            project.unknown_components.erase(f.name);
+            continue;
+          }
+
+          // Update the component database
+          if (f.path.string().starts_with(workspace.shared_components_path.string())) {
+            spdlog::info("Scanning for new component in shared database");
+            workspace.shared_database.scan_for_components(f.path);
+            workspace.shared_database.save();
+          } else {
+            spdlog::info("Scanning for new component in local database");
+            workspace.local_database.scan_for_components(f.path);
+            workspace.local_database.save();
+          }
+
+          spdlog::info("Fetched {}: requires {} components", f.name, f.required_components.size());
+          for (const auto &r: f.required_components)
+            request_fetch(r);
+        }
+        start_fetches();
       }
 
       // Check if any of our unknown components have been found
@@ -530,12 +599,9 @@ static void download_unknown_components(yakka::workspace &workspace, yakka::proj
           ++i;
       }
 
-      // Remove the item from the fetch list
-      fetch_list.erase(completed_fetch);
-
       // Re-evaluate the project dependencies
       project.evaluate_dependencies();
-    } while (!project.unprocessed_components.empty() || !project.unknown_components.empty() || !fetch_list.empty());
+    } while (!project.unprocessed_components.empty() || !project.unknown_components.empty());
   }
 
   auto t2       = std::chrono::high_resolution_clock::now();
@@ -1,5 +1,6 @@
 #include "yakka_component.hpp"
 #include "yakka_schema.hpp"
+#include "yakka_stats.hpp"
 #include "spdlog/spdlog.h"
 #include "semver/semver.hpp"
 
@@ -8,6 +9,8 @@ using namespace semver::literals;
 namespace yakka {
 yakka_status component::parse_file(fs::path file_path, fs::path package_path)
 {
+  static auto &stats = get_stat_counter("component parse_file");
+  scoped_stat_timer timer(stats);
   this->file_path         = file_path;
   this->package_path      = package_path;
   std::string path_string = file_path.generic_string();
@@ -1,27 +1,213 @@
 #include "yakka.hpp"
 #include "yakka_project.hpp"
 #include "yakka_schema.hpp"
+#include "copy_engine.hpp"
+#include "file_cache.hpp"
+#include "pack_format.hpp"
 #include "utilities.hpp"
+#include "yakka_stats.hpp"
 #include "spdlog/spdlog.h"
 #include "glob/glob.h"
+#include "algorithm/for_each.hpp"
 #include <nlohmann/json-schema.hpp>
 #include <fstream>
+#include <sstream>
 #include <chrono>
 #include <thread>
 #include <string>
 #include <charconv>
+#include <set>
 
 namespace yakka {
 using namespace std::chrono_literals;
 
+// Requirement source used for the components and features named when the project was created
+static const std::string initial_requirement_source = "<project>";
+
+/**
+ * @brief Adds the names in a Jinja2 template file that match a template contribution, following included, imported and extended templates.
+ *        Every identifier inside '{{ }}' and '{% %}' markup is considered, so the result may include names the template doesn't read.
+ *        Referenced templates are resolved relative to the template that names them.
+ * @return False if the template, or a template it references, couldn't be read or resolved
+ */
+static bool scan_template_references(const fs::path &template_path, const std::unordered_set<std::string> &names, std::set<std::string> &result, std::set<fs::path> &scanned)
+{
+  if (!scanned.insert(template_path.lexically_normal()).second)
+    return true;
+
+  std::ifstream file(template_path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  const std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+  static const std::unordered_set<std::string> reference_tags = { "include", "import", "from", "extends" };
+  auto is_identifier_char = [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+  for (size_t start = text.find('{'); start != std::string::npos; start = text.find('{', start + 1)) {
+    if (start + 1 >= text.size() || (text[start + 1] != '{' && text[start + 1] != '%'))
+      continue;
+    const bool is_statement = text[start + 1] == '%';
+    const auto end          = text.find(is_statement ? "%}" : "}}", start + 2);
+    if (end == std::string::npos)
+      break;
+
+    bool first_word = true;
+    bool reference  = false;
+    for (size_t i = start + 2; i < end;) {
+      if (!is_identifier_char(text[i])) {
+        ++i;
+        continue;
+      }
+      const auto word_start = i;
+      while (i < end && is_identifier_char(text[i]))
+        ++i;
+      const auto word = text.substr(word_start, i - word_start);
+      if (first_word && is_statement)
+        reference = reference_tags.contains(word);
+      first_word = false;
+      if (names.contains(word))
+        result.insert(word);
+    }
+
+    // Scan the templates named by string literals. A computed name can't be followed
+    if (reference) {
+      bool found_literal = false;
+      for (size_t i = start + 2; i < end; ++i) {
+        if (text[i] != '"' && text[i] != '\'')
+          continue;
+        const auto literal_end = text.find(text[i], i + 1);
+        if (literal_end == std::string::npos || literal_end > end)
+          return false;
+        found_literal = true;
+        if (!scan_template_references(template_path.parent_path() / text.substr(i + 1, literal_end - i - 1), names, result, scanned))
+          return false;
+        i = literal_end;
+      }
+      if (!found_literal)
+        return false;
+    }
+    start = end;
+  }
+  return true;
+}
+
+/**
+ * @brief Returns the names in a Jinja2 template file and the templates it references that match a template contribution.
+ *        The templates that were read, or couldn't be read, are added to scanned.
+ * @return The sorted names, or nothing if the referenced templates couldn't be determined
+ */
+static std::optional<std::vector<std::string>> template_contribution_references(const fs::path &template_path, const std::unordered_set<std::string> &names, std::set<fs::path> &scanned)
+{
+  std::set<std::string> result;
+  if (!scan_template_references(template_path, names, result, scanned))
+    return {};
+  return std::vector<std::string>(result.begin(), result.end());
+}
+
+/**
+ * @brief Returns the names under the 'supports' entry of a node that are in the required set.
+ *        The names are collected first as applying a support can modify the node.
+ */
+static std::vector<std::string> required_supports(const nlohmann::json &node, const std::string &kind, const std::unordered_set<std::string> &required)
+{
+  std::vector<std::string> names;
+  const auto supports = node.find("supports");
+  if (supports == node.end() || !supports->is_object())
+    return names;
+
+  const auto entries = supports->find(kind);
+  if (entries == supports->end() || !entries->is_object())
+    return names;
+
+  for (const auto &[name, value]: entries->items())
+    if (required.contains(name))
+      names.push_back(name);
+
+  return names;
+}
+
+/**
+ * @brief Converts structured step output to YAML. Scalars other than strings are written in their JSON form.
+ */
+static YAML::Node json_to_yaml(const nlohmann::json &value)
+{
+  YAML::Node node;
+  if (value.is_object())
+    for (const auto &[key, item]: value.items())
+      node[key] = json_to_yaml(item);
+  else if (value.is_array())
+    for (const auto &item: value)
+      node.push_back(json_to_yaml(item));
+  else if (value.is_string())
+    node = value.get<std::string>();
+  else if (!value.is_null())
+    node = value.dump();
+  return node;
+}
+
+/**
+ * @brief Returns the text of a step's input. Structured input is serialized as YAML the first time a step asks for it as text.
+ */
+static std::string &input_text(yakka::process_data &input)
+{
+  if (input.text.empty() && !input.value.empty()) {
+    input.text = YAML::Dump(json_to_yaml(input.value));
+    input.text.append("\n");
+  }
+  return input.text;
+}
+
+/**
+ * @brief Returns the file that records when a target was last processed. A command that leaves an unchanged target untouched updates it
+ *        so the target isn't processed again until one of its dependencies is newer than the stamp.
+ */
+static std::string process_stamp(std::string_view target_name)
+{
+  return std::string(target_name).append(".stamp");
+}
+
+static void update_process_stamp(std::string_view target_name)
+{
+  const auto stamp = process_stamp(target_name);
+  if (!fs::exists(stamp))
+    std::ofstream(stamp, std::ios_base::binary);
+  fs::last_write_time(stamp, fs::file_time_type::clock::now());
+}
+
+static bool processed_since(std::string_view target_name, fs::file_time_type time)
+{
+  const auto stamp = process_stamp(target_name);
+  return timed_exists(stamp) && timed_last_write_time(stamp) >= time;
+}
+
 project::project(const std::string project_name, yakka::workspace &workspace) : project_name(project_name), yakka_home_directory("/.yakka"), project_directory("."), workspace(workspace)
 {
-  abort_build      = false;
-  project_has_slcc = false;
-  current_state    = yakka::project::state::PROJECT_VALID;
-  component_flags  = component_database::flag::ALL_COMPONENTS;
+  abort_build           = false;
+  project_has_slcc      = false;
+  current_state         = yakka::project::state::PROJECT_VALID;
+  component_flags       = component_database::flag::ALL_COMPONENTS;
+  evaluation_iterations = 0;
+  retraction_count      = 0;
 
   add_common_template_commands(inja_environment);
+
+  slc_resolver.find_feature = [this](const std::string &feature) {
+    return this->workspace.find_feature(feature);
+  };
+  slc_resolver.add_component = [this](const std::string &name, const std::string &requirement, const nlohmann::json *recommendation) {
+    if (recommendation) {
+      spdlog::info("Adding recommended component '{}' to satisfy '{}'", name, requirement);
+      if (recommendation->contains("instance")) {
+        for (const auto &i: (*recommendation)["instance"]) {
+          spdlog::info("Creating instance '{}' for '{}'", i.get<std::string>(), name);
+          add_instance(name, i.get<std::string>(), yakka::component_dotname_to_id(name));
+        }
+      }
+    } else
+      spdlog::info("Adding component '{}' to satisfy '{}'", name, requirement);
+    add_component(name, component_database::flag::ONLY_SLCC);
+  };
 }
 
 project::~project()
@@ -56,9 +242,9 @@ void project::init_project(const std::string build_string)
   process_build_string(build_string);
 
   for (const auto &c: initial_components)
-    unprocessed_components.insert(c);
+    require_component(c, initial_requirement_source);
   for (const auto &f: initial_features)
-    unprocessed_features.insert(f);
+    require_feature(f, initial_requirement_source);
   init_project();
 }
 
@@ -67,11 +253,11 @@ void project::init_project(std::vector<std::string> components, std::vector<std:
   initial_features = features;
 
   for (const auto &c: components) {
-    unprocessed_components.insert(c);
+    require_component(c, initial_requirement_source);
     initial_components.push_back(c);
   }
   for (const auto &f: features) {
-    unprocessed_features.insert(f);
+    require_feature(f, initial_requirement_source);
     initial_features.push_back(f);
   }
   init_project();
@@ -80,10 +266,24 @@ void project::init_project(std::vector<std::string> components, std::vector<std:
 void project::init_project()
 {
   output_path          = yakka::default_output_directory + project_name;
-  project_summary_file = output_path + "/yakka_summary.json";
+  project_summary_file          = output_path + "/yakka_summary.json";
+  project_summary_snapshot_file = output_path + "/yakka_summary.cbor";
+  project_resolution_file       = output_path + "/yakka_resolution.cbor";
+  project_summary_snapshot_hash = 0;
+  get_file_cache().add_output_directory(output_path);
   // previous_summary["components"] = YAML::Node();
 
-  if (fs::exists(project_summary_file)) {
+  if (fs::exists(project_summary_snapshot_file)) {
+    project_summary_last_modified = fs::last_write_time(project_summary_snapshot_file);
+    load_summary_snapshot();
+
+    // Fill required_features with features from project summary
+    for (auto &f: project_summary["features"])
+      required_features.insert(f.get<std::string>());
+
+    project_summary["choices"] = {};
+    update_summary();
+  } else if (fs::exists(project_summary_file)) {
     project_summary_last_modified = fs::last_write_time(project_summary_file);
     std::ifstream i(project_summary_file);
     i >> project_summary;
@@ -99,19 +299,20 @@ void project::init_project()
     fs::create_directories(output_path);
 }
 
-void project::process_requirements(std::shared_ptr<yakka::component> component, nlohmann::json child_node)
+void project::process_requirements(std::shared_ptr<yakka::component> component, nlohmann::json child_node, const std::string &source)
 {
   // Merge the feature values into the parent component
   json_node_merge(component->json, child_node);
+  index_supports(component, child_node);
 
   // Process required components
   if (child_node.contains("/requires/components"_json_pointer)) {
     // Add the item/s to the new_component list
     if (child_node["requires"]["components"].is_string())
-      unprocessed_components.insert(child_node["requires"]["components"].get<std::string>());
+      require_component(child_node["requires"]["components"].get<std::string>(), source);
     else if (child_node["requires"]["components"].is_array())
       for (const auto &i: child_node["requires"]["components"])
-        unprocessed_components.insert(i.get<std::string>());
+        require_component(i.get<std::string>(), source);
     else
       spdlog::error("Node '{}' has invalid 'requires'", child_node["requires"].get<std::string>());
   }
@@ -122,14 +323,14 @@ void project::process_requirements(std::shared_ptr<yakka::component> component,
     if (child_node["requires"]["features"].is_string()) {
       const auto feature = child_node["requires"]["features"].get<std::string>();
       if (component->type == yakka::component::SLCC_FILE || component->type == yakka::component::SLCP_FILE)
-        slc_required.insert(feature);
-      unprocessed_features.insert(feature);
+        require_slc_feature(feature, source);
+      require_feature(feature, source);
     } else if (child_node["requires"]["features"].is_array())
       for (const auto &i: child_node["requires"]["features"]) {
         const auto feature = i.get<std::string>();
         if (component->type == yakka::component::SLCC_FILE || component->type == yakka::component::SLCP_FILE)
-          slc_required.insert(feature);
-        unprocessed_features.insert(feature);
+          require_slc_feature(feature, source);
+        require_feature(feature, source);
       }
     else
       spdlog::error("Node '{}' has invalid 'requires'", child_node["requires"].get<std::string>());
@@ -141,14 +342,14 @@ void project::process_requirements(std::shared_ptr<yakka::component> component,
     if (child_node_provides.is_string()) {
       const auto feature = child_node_provides.get<std::string>();
       if (component->type == yakka::component::SLCC_FILE || component->type == yakka::component::SLCP_FILE)
-        slc_provided.insert(feature);
-      unprocessed_features.insert(feature);
+        provide_slc_feature(feature, source);
+      require_feature(feature, source);
     } else if (child_node_provides.is_array())
       for (const auto &i: child_node_provides) {
         const auto feature = i.get<std::string>();
         if (component->type == yakka::component::SLCC_FILE || component->type == yakka::component::SLCP_FILE)
-          slc_provided.insert(feature);
-        unprocessed_features.insert(feature);
+          provide_slc_feature(feature, source);
+        require_feature(feature, source);
       }
   }
 
@@ -158,26 +359,316 @@ void project::process_requirements(std::shared_ptr<yakka::component> component,
       unprocessed_choices.insert(choice_name);
       project_summary["choices"][choice_name]           = choice;
       project_summary["choices"][choice_name]["parent"] = component->json["name"].get<std::string>();
+      requirement_sources[source].choices.push_back(choice_name);
     }
   }
 
   // Process supported components
-  if (child_node.contains("/supports/components"_json_pointer)) {
-    for (const auto &c: required_components)
-      if (child_node["supports"]["components"].contains(c)) {
-        spdlog::info("Processing component '{}' in {}", c, component->json["name"].get<std::string>());
-        process_requirements(component, child_node["supports"]["components"][c]);
-      }
+  for (const auto &c: required_supports(child_node, "components", required_components)) {
+    spdlog::info("Processing component '{}' in {}", c, component->json["name"].get<std::string>());
+    apply_support(component, "components", c, child_node["supports"]["components"][c], source);
   }
 
   // Process supported features
-  if (child_node.contains("/supports/features"_json_pointer)) {
-    for (const auto &f: required_features)
-      if (child_node["supports"]["features"].contains(f)) {
-        spdlog::info("Processing feature '{}' in {}", f, component->json["name"].get<std::string>());
-        process_requirements(component, child_node["supports"]["features"][f]);
+  for (const auto &f: required_supports(child_node, "features", required_features)) {
+    spdlog::info("Processing feature '{}' in {}", f, component->json["name"].get<std::string>());
+    apply_support(component, "features", f, child_node["supports"]["features"][f], source);
+  }
+}
+
+/**
+ * @brief Adds the 'supports' entries of a node to the reverse indexes for a component
+ */
+void project::index_supports(std::shared_ptr<yakka::component> component, const nlohmann::json &node)
+{
+  const auto supports = node.find("supports");
+  if (supports == node.end() || !supports->is_object())
+    return;
+
+  auto index_kind = [&](const std::string &kind, std::unordered_map<std::string, std::vector<std::shared_ptr<yakka::component>>> &index) {
+    const auto entries = supports->find(kind);
+    if (entries == supports->end() || !entries->is_object())
+      return;
+    for (const auto &[name, value]: entries->items()) {
+      auto &supporters = index[name];
+      if (std::find(supporters.begin(), supporters.end(), component) == supporters.end())
+        supporters.push_back(component);
+    }
+  };
+
+  index_kind("components", component_supporters);
+  index_kind("features", feature_supporters);
+}
+
+void project::unindex_supports(std::shared_ptr<yakka::component> component)
+{
+  const auto supports = component->json.find("supports");
+  if (supports == component->json.end() || !supports->is_object())
+    return;
+
+  auto unindex_kind = [&](const std::string &kind, std::unordered_map<std::string, std::vector<std::shared_ptr<yakka::component>>> &index) {
+    const auto entries = supports->find(kind);
+    if (entries == supports->end() || !entries->is_object())
+      return;
+    for (const auto &[name, value]: entries->items()) {
+      auto supporters = index.find(name);
+      if (supporters != index.end())
+        std::erase(supporters->second, component);
+    }
+  };
+
+  unindex_kind("components", component_supporters);
+  unindex_kind("features", feature_supporters);
+}
+
+/**
+ * @brief Merges a 'supports' node into a component and records the application so it can be undone
+ *        if the component or feature that triggered it is later retracted.
+ */
+void project::apply_support(std::shared_ptr<yakka::component> component, const std::string &kind, const std::string &name, const nlohmann::json &node, const std::string &parent)
+{
+  const auto source = parent + "/supports/" + kind + "/" + name;
+
+  // Keep the unmodified component data so the merge can be replayed without this node
+  if (!original_component_json.contains(component->id))
+    original_component_json.insert({ component->id, component->json });
+
+  support_applications.push_back({ component->id, kind, name, parent, source, node });
+  process_requirements(component, support_applications.back().node, source);
+}
+
+void project::require_component(const std::string &component_name, const std::string &source)
+{
+  const auto component_id = yakka::component_dotname_to_id(component_name);
+  retracted_components.erase(component_id);
+  component_requirers[component_id].insert(source);
+  requirement_sources[source].components.push_back(component_name);
+  unprocessed_components.insert(component_name);
+}
+
+void project::require_feature(const std::string &feature_name, const std::string &source)
+{
+  retracted_features.erase(feature_name);
+  feature_requirers[feature_name].insert(source);
+  requirement_sources[source].features.push_back(feature_name);
+  unprocessed_features.insert(feature_name);
+}
+
+void project::require_slc_feature(const std::string &feature_name, const std::string &source)
+{
+  requirement_sources[source].slc_required.push_back(feature_name);
+  slc_required.insert(feature_name);
+}
+
+void project::provide_slc_feature(const std::string &feature_name, const std::string &source)
+{
+  requirement_sources[source].slc_provided.push_back(feature_name);
+  if (slc_provided.insert(feature_name).second)
+    slc_resolver.provide(feature_name);
+}
+
+void project::add_instance(const std::string &component_name, const std::string &instance_name, const std::string &source)
+{
+  requirement_sources[source].instances.push_back({ component_name, instance_name });
+  instances.insert({ component_name, instance_name });
+}
+
+/**
+ * @brief Removes a component from the project along with everything that was only required because of it
+ */
+void project::retract_component(const std::string &component_id)
+{
+  retracted_components.insert(component_id);
+  unknown_components.erase(component_id);
+
+  auto c = std::find_if(components.begin(), components.end(), [&](const auto &i) {
+    return i->id == component_id;
+  });
+  if (c == components.end())
+    return;
+
+  spdlog::info("Retracting component '{}'", component_id);
+  ++retraction_count;
+  unindex_supports(*c);
+  std::erase_if(slc_overrides, [&](const auto &o) {
+    return o.second == *c;
+  });
+  components.erase(c);
+  required_components.erase(component_id);
+  original_component_json.erase(component_id);
+  if (project_summary["components"].is_object())
+    project_summary["components"].erase(component_id);
+
+  // Undo the supports that other components applied because this component was present
+  retract_support_applications([&](const support_application &a) {
+    return a.kind == "components" && a.name == component_id;
+  });
+
+  // Drop everything the component introduced
+  retract_source(component_id);
+}
+
+void project::retract_feature(const std::string &feature_name)
+{
+  retracted_features.insert(feature_name);
+  if (required_features.erase(feature_name) == 0)
+    return;
+
+  spdlog::info("Retracting feature '{}'", feature_name);
+  ++retraction_count;
+  retract_support_applications([&](const support_application &a) {
+    return a.kind == "features" && a.name == feature_name;
+  });
+}
+
+/**
+ * @brief Removes the requirements introduced by a source. Components and features that are no longer required by anything are retracted.
+ */
+void project::retract_source(const std::string &source)
+{
+  auto node = requirement_sources.extract(source);
+  if (!node.empty()) {
+    const auto &r = node.mapped();
+
+    for (const auto &name: r.components) {
+      // Follow replacements as their requirers were inherited by the replacing component
+      auto id = yakka::component_dotname_to_id(name);
+      for (size_t depth = 0; depth <= replacements.size(); ++depth) {
+        auto requirers = component_requirers.find(id);
+        if (requirers != component_requirers.end() && requirers->second.erase(source) != 0 && requirers->second.empty()) {
+          component_requirers.erase(requirers);
+          unprocessed_components.erase(name);
+          retract_component(id);
+        }
+        auto replacement = replacements.find(id);
+        if (replacement == replacements.end())
+          break;
+        id = replacement->second;
+      }
+    }
+
+    for (const auto &f: r.features) {
+      auto requirers = feature_requirers.find(f);
+      if (requirers != feature_requirers.end() && requirers->second.erase(source) != 0 && requirers->second.empty()) {
+        feature_requirers.erase(requirers);
+        unprocessed_features.erase(f);
+        retract_feature(f);
+      }
+    }
+
+    for (const auto &c: r.choices) {
+      unprocessed_choices.erase(c);
+      if (project_summary["choices"].is_object())
+        project_summary["choices"].erase(c);
+      retract_source("choice:" + c);
+    }
+
+    // SLC features stay required or provided while another source still requires or provides them
+    auto still_listed = [&](const std::string &feature, std::vector<std::string> requirement_source::*list) {
+      return std::any_of(requirement_sources.begin(), requirement_sources.end(), [&](const auto &s) {
+        return std::find((s.second.*list).begin(), (s.second.*list).end(), feature) != (s.second.*list).end();
+      });
+    };
+    for (const auto &f: r.slc_required)
+      if (!still_listed(f, &requirement_source::slc_required))
+        slc_required.erase(f);
+    for (const auto &f: r.slc_provided)
+      if (!still_listed(f, &requirement_source::slc_provided))
+        slc_provided.erase(f);
+
+    for (const auto &[component_name, instance_name]: r.instances) {
+      auto range    = instances.equal_range(component_name);
+      auto instance = std::find_if(range.first, range.second, [&](const auto &i) {
+        return i.second == instance_name;
+      });
+      if (instance != range.second)
+        instances.erase(instance);
+    }
+  }
+
+  // Undo the supports applied as part of this source
+  retract_support_applications([&](const support_application &a) {
+    return a.parent == source;
+  });
+}
+
+void project::retract_support_applications(std::function<bool(const support_application &)> predicate)
+{
+  std::vector<std::string> sources;
+  std::unordered_set<std::string> affected_components;
+
+  std::erase_if(support_applications, [&](const support_application &a) {
+    if (!predicate(a))
+      return false;
+    sources.push_back(a.source);
+    affected_components.insert(a.component_id);
+    return true;
+  });
+
+  // Rebuild the affected components from their original data and the remaining supports
+  for (const auto &id: affected_components) {
+    auto c        = std::find_if(components.begin(), components.end(), [&](const auto &i) {
+      return i->id == id;
+    });
+    auto original = original_component_json.find(id);
+    if (c == components.end() || original == original_component_json.end())
+      continue;
+
+    unindex_supports(*c);
+    (*c)->json = original->second;
+    index_supports(*c, (*c)->json);
+    for (const auto &a: support_applications)
+      if (a.component_id == id) {
+        json_node_merge((*c)->json, a.node);
+        index_supports(*c, a.node);
       }
   }
+
+  for (const auto &s: sources)
+    retract_source(s);
+}
+
+/**
+ * @brief Loads the binary summary snapshot written by @ref save_summary.
+ *        Each component is stored as its own CBOR byte string so only a stub with its 'yakka_file' is placed in the summary.
+ *        The full component is decoded by @ref load_previous_summary_component when a data dependency needs it.
+ */
+void project::load_summary_snapshot()
+{
+  const auto snapshot           = yakka::get_file_contents<std::string>(project_summary_snapshot_file);
+  project_summary_snapshot_hash = std::hash<std::string>{}(snapshot);
+
+  try {
+    project_summary = nlohmann::json::from_cbor(snapshot);
+  } catch (std::exception &e) {
+    spdlog::error("Failed to load project summary snapshot '{}'\n{}", project_summary_snapshot_file, e.what());
+    project_summary               = {};
+    project_summary_snapshot_hash = 0;
+    return;
+  }
+
+  for (auto &[name, value]: project_summary["components"].items()) {
+    nlohmann::json stub = nlohmann::json::object();
+    if (value.contains("yakka_file"))
+      stub["yakka_file"] = value["yakka_file"];
+    if (value.contains("data") && value["data"].is_binary()) {
+      summary_snapshot_components[name] = std::move(value["data"].get_binary());
+      summary_snapshot_stubs.insert(name);
+    }
+    value = std::move(stub);
+  }
+}
+
+/**
+ * @brief Decodes the previous value of a component from the summary snapshot into @ref previous_summary
+ */
+void project::load_previous_summary_component(const std::string &name)
+{
+  auto snapshot = summary_snapshot_components.find(name);
+  if (snapshot == summary_snapshot_components.end() || previous_summary["components"].contains(name))
+    return;
+
+  previous_summary["components"][name] = nlohmann::json::from_cbor(snapshot->second);
 }
 
 void project::update_summary()
@@ -193,12 +684,18 @@ void project::update_summary()
 
     auto yakka_file = value["yakka_file"].get<std::string>();
 
+    // Components from the snapshot are decoded into the previous summary on demand
+    const bool in_snapshot = summary_snapshot_components.contains(name);
+
     if (!std::filesystem::exists(yakka_file) || std::filesystem::last_write_time(yakka_file) > project_summary_last_modified) {
       // If so, move existing data to previous summary
-      previous_summary["components"][name] = value; // TODO: Verify this is correct way to do this efficiently
-      project_summary["components"][name]  = {};
+      // The current entry is discarded so its data is moved rather than copied
+      if (!in_snapshot)
+        previous_summary["components"][name] = std::move(value);
+      project_summary["components"][name] = {};
+      summary_snapshot_stubs.erase(name);
       unprocessed_components.insert(name);
-    } else {
+    } else if (!in_snapshot) {
       // Previous summary should point to the same object
       previous_summary["components"][name] = value;
     }
@@ -212,11 +709,19 @@ bool project::add_component(const std::string &component_name, component_databas
 
   // Check if component has been replaced
   if (replacements.contains(component_id)) {
-    spdlog::info("Skipping {}. Being replaced by {}", component_id, replacements[component_id]);
-    unprocessed_components.insert(replacements[component_id]);
+    const auto &replacement = replacements[component_id];
+    spdlog::info("Skipping {}. Being replaced by {}", component_id, replacement);
+    // Anything that requires the replaced component now requires the replacement
+    if (component_requirers.contains(component_id))
+      component_requirers[replacement].insert(component_requirers[component_id].begin(), component_requirers[component_id].end());
+    unprocessed_components.insert(replacement);
     return false;
   }
 
+  // Skip components that are no longer required
+  if (retracted_components.contains(component_id))
+    return false;
+
   // Find the component in the project component database
   auto component_location = workspace.find_component(component_id, flags);
   if (!component_location) {
@@ -232,9 +737,10 @@ bool project::add_component(const std::string &component_name, component_databas
 
   auto [component_path, package_path]             = component_location.value();
   std::shared_ptr<yakka::component> new_component = std::make_shared<yakka::component>();
-  if (new_component->parse_file(component_path, package_path) == yakka::yakka_status::SUCCESS)
+  if (parse_component(new_component, component_path, package_path) == yakka::yakka_status::SUCCESS) {
     components.push_back(new_component);
-  else {
+    index_supports(new_component, new_component->json);
+  } else {
     current_state = project::state::PROJECT_HAS_INVALID_COMPONENT;
     return false;
   }
@@ -243,14 +749,14 @@ bool project::add_component(const std::string &component_name, component_databas
   if (new_component->type == yakka::component::YAKKA_FILE) {
     if (this->project_has_slcc)
       for (const auto &f: new_component->json["requires"]["slc"])
-        slc_required.insert(f.get<std::string>());
+        require_slc_feature(f.get<std::string>(), component_id);
   } else if (new_component->type == yakka::component::SLCC_FILE) {
     project_has_slcc = true;
-    unprocessed_components.insert("jinja");
+    require_component("jinja", component_id);
     for (const auto &f: new_component->json["requires"]["features"])
-      slc_required.insert(f.get<std::string>());
+      require_slc_feature(f.get<std::string>(), component_id);
     for (const auto &f: new_component->json["provides"]["features"])
-      slc_provided.insert(f.get<std::string>());
+      provide_slc_feature(f.get<std::string>(), component_id);
     for (const auto &r: new_component->json["recommends"]) {
       auto id        = r["id"].get<std::string>();
       auto start_pos = id.find('%');
@@ -261,7 +767,7 @@ bool project::add_component(const std::string &component_name, component_databas
     }
     for (const auto &[key, instance_list]: new_component->json["instances"].items())
       for (const auto &i: instance_list)
-        this->instances.insert({ key, i.get<std::string>() });
+        add_instance(key, i.get<std::string>(), component_id);
     // Extract config overrides
     for (const auto &c: new_component->json["config_file"])
       if (c.contains("override")) {
@@ -269,9 +775,9 @@ bool project::add_component(const std::string &component_name, component_databas
       }
 
   } else if (new_component->type == yakka::component::SLCP_FILE) {
-    unprocessed_components.insert("jinja");
+    require_component("jinja", component_id);
     for (const auto &f: new_component->json["requires"]["features"])
-      slc_required.insert(f.get<std::string>());
+      require_slc_feature(f.get<std::string>(), component_id);
     for (const auto &r: new_component->json["recommends"]) {
       auto id        = r["id"].get<std::string>();
       auto start_pos = id.find('%');
@@ -282,28 +788,28 @@ bool project::add_component(const std::string &component_name, component_databas
     }
     for (const auto &[key, instance_list]: new_component->json["instances"].items())
       for (const auto &i: instance_list)
-        this->instances.insert({ key, i.get<std::string>() });
+        add_instance(key, i.get<std::string>(), component_id);
   }
 
   // Add all the required components into the unprocessed list
   if (new_component->json.contains("/requires/components"_json_pointer))
     for (const auto &r: new_component->json["requires"]["components"]) {
-      unprocessed_components.insert(r.get<std::string>());
+      require_component(r.get<std::string>(), component_id);
       if (r.contains("instance")) {
         for (const auto &i: r["instance"])
-          instances.insert({ r.get<std::string>(), i.get<std::string>() });
+          add_instance(r.get<std::string>(), i.get<std::string>(), component_id);
       }
     }
 
   // Add all the required features into the unprocessed list
   if (new_component->json.contains("/requires/features"_json_pointer))
     for (const auto &f: new_component->json["requires"]["features"])
-      unprocessed_features.insert(f.get<std::string>());
+      require_feature(f.get<std::string>(), component_id);
 
   // Add all the provided features into the unprocessed list
   if (new_component->json.contains("/provides/features"_json_pointer))
     for (const auto &f: new_component->json["provides"]["features"])
-      unprocessed_features.insert(f.get<std::string>());
+      require_feature(f.get<std::string>(), component_id);
 
   // Add all the component choices to the global choice list
   if (new_component->json.contains("choices"))
@@ -312,11 +818,12 @@ bool project::add_component(const std::string &component_name, component_databas
         unprocessed_choices.insert(choice_name);
         project_summary["choices"][choice_name]           = value;
         project_summary["choices"][choice_name]["parent"] = new_component->id;
+        requirement_sources[component_id].choices.push_back(choice_name);
       }
     }
 
   if (new_component->json.contains("/replaces/component"_json_pointer)) {
-    const auto &replaced = new_component->json["replaces"]["component"].get<std::string>();
+    const auto replaced = new_component->json["replaces"]["component"].get<std::string>();
 
     if (replacements.contains(replaced)) {
       if (replacements[replaced] != component_id) {
@@ -326,51 +833,62 @@ bool project::add_component(const std::string &component_name, component_databas
       }
     } else {
       spdlog::info("{} replaces {}", component_id, replaced);
-      unprocessed_replacements.insert({ replaced, component_id });
+      replacements.insert({ replaced, component_id });
+
+      // Anything that requires the replaced component now requires the replacement
+      if (component_requirers.contains(replaced))
+        component_requirers[component_id].insert(component_requirers[replaced].begin(), component_requirers[replaced].end());
+
+      // Remove the replaced component and everything only it contributed
+      retract_component(replaced);
+      if (!required_components.contains(component_id))
+        return true;
     }
   }
 
   // Process all the currently required features. Note new feature will be processed in the features pass
-  if (new_component->json.contains("/supports/features"_json_pointer)) {
-    for (auto &f: required_features)
-      if (new_component->json["supports"]["features"].contains(f)) {
-        spdlog::info("Processing required feature '{}' in {}", f, component_id);
-        process_requirements(new_component, new_component->json["supports"]["features"][f]);
-      }
+  for (const auto &f: required_supports(new_component->json, "features", required_features)) {
+    spdlog::info("Processing required feature '{}' in {}", f, component_id);
+    apply_support(new_component, "features", f, new_component->json["supports"]["features"][f], component_id);
   }
-  if (new_component->json.contains("/supports/components"_json_pointer)) {
-    // Process the new components support for all the currently required components
-    for (auto &c: required_components)
-      if (new_component->json["supports"]["components"].contains(c)) {
-        spdlog::info("Processing required component '{}' in {}", c, component_id);
-        process_requirements(new_component, new_component->json["supports"]["components"][c]);
-      }
+
+  // Process the new components support for all the currently required components
+  for (const auto &c: required_supports(new_component->json, "components", required_components)) {
+    spdlog::info("Processing required component '{}' in {}", c, component_id);
+    apply_support(new_component, "components", c, new_component->json["supports"]["components"][c], component_id);
   }
 
-  // Process all the existing components support for the new component
-  for (auto &c: components)
-    if (c->json.contains("/supports/components"_json_pointer / component_id)) {
-      // if (c->json.contains("supports") && c->json["supports"].contains("components") && c->json["supports"]["components"].contains(component_id)) {
+  // Process all the existing components support for the new component.
+  // Note the supporter list is copied as applying a support can add to the index
+  if (component_supporters.contains(component_id)) {
+    const auto supporters = component_supporters[component_id];
+    for (auto &c: supporters) {
       spdlog::info("Processing component '{}' in {}", component_id, c->json["name"].get<std::string>());
-      process_requirements(c, c->json["supports"]["components"][component_id]);
+      apply_support(c, "components", component_id, c->json["supports"]["components"][component_id], c->id);
     }
+  }
 
   return true;
 }
 
 bool project::add_feature(const std::string &feature_name)
 {
+  // Skip features that are no longer required
+  if (retracted_features.contains(feature_name))
+    return false;
+
   // Insert feature and continue if this is not new
   if (required_features.insert(feature_name).second == false)
     return false;
 
-  // Process the feature "supports" for each existing component
-  for (auto &c: components)
-    if (c->json.contains("/supports/features"_json_pointer / feature_name)) {
-      // if (c->json.contains("supports") && c->json["supports"].contains("features") && c->json["supports"]["features"].contains(f)) {
+  // Process the feature "supports" for each existing component that references it
+  if (feature_supporters.contains(feature_name)) {
+    const auto supporters = feature_supporters[feature_name];
+    for (auto &c: supporters) {
       spdlog::info("Processing feature '{}' in {}", feature_name, c->json["name"].get<std::string>());
-      process_requirements(c, c->json["supports"]["features"][feature_name]);
+      apply_support(c, "features", feature_name, c->json["supports"]["features"][feature_name], c->id);
     }
+  }
 
   return true;
 }
@@ -378,14 +896,28 @@ bool project::add_feature(const std::string &feature_name)
 /**
  * @brief Processes all the @ref unprocessed_components and @ref unprocessed_features, adding items to @ref unknown_components if they are not in the component database
  *        It is assumed the caller will process the @ref unknown_components before adding them back to @ref unprocessed_component and calling this again.
+ *        Replaced components are retracted as they are discovered so the evaluation never restarts.
  * @return project::state
  */
 project::state project::evaluate_dependencies()
 {
   //project_has_slcc = false;
+  evaluation_iterations = 0;
+  retraction_count      = 0;
+
+  // The workspace databases may have changed since the last evaluation
+  slc_resolver.clear_cache();
+
+  // SLC features required from outside the evaluation, such as with --with, stay required if a component that also requires them is retracted
+  auto &initial_slc_required = requirement_sources[initial_requirement_source].slc_required;
+  for (const auto &f: slc_required)
+    if (std::find(initial_slc_required.begin(), initial_slc_required.end(), f) == initial_slc_required.end())
+      initial_slc_required.push_back(f);
 
   // Start processing all the required components and features
   while (!unprocessed_components.empty() || !unprocessed_features.empty() || !slc_required.empty()) {
+    ++evaluation_iterations;
+
     // Loop through the list of unprocessed components.
     // Note: Items will be added to unprocessed_components during processing
     component_list_t temp_component_list = std::move(unprocessed_components);
@@ -406,129 +938,51 @@ project::state project::evaluate_dependencies()
 
     // Check if we have finished but we have unprocessed choices
     if (unprocessed_components.empty() && unprocessed_features.empty() && !unprocessed_choices.empty()) {
-      for (const auto &c: unprocessed_choices) {
-        const auto &choice = project_summary["choices"][c];
-        int matches        = 0;
+      // Apply every default that is still required once the defaults selected in this pass are taken into account
+      std::unordered_set<std::string> selected_features;
+      std::unordered_set<std::string> selected_components;
+      for (auto c = unprocessed_choices.begin(); c != unprocessed_choices.end();) {
+        const auto choice_name = *c;
+        const auto &choice     = project_summary["choices"][choice_name];
+        int matches            = 0;
         if (choice.contains("features"))
           matches = std::count_if(choice["features"].begin(), choice["features"].end(), [&](const nlohmann::json &j) {
-            return required_features.contains(j.get<std::string>());
+            return required_features.contains(j.get<std::string>()) || selected_features.contains(j.get<std::string>());
           });
         else if (choice.contains("components"))
           matches = std::count_if(choice["components"].begin(), choice["components"].end(), [&](const nlohmann::json &j) {
-            return required_components.contains(j.get<std::string>());
+            return required_components.contains(j.get<std::string>()) || selected_components.contains(j.get<std::string>());
           });
         else {
-          spdlog::error("Invalid choice {}", c);
+          spdlog::error("Invalid choice {}", choice_name);
           return project::state::PROJECT_HAS_INVALID_COMPONENT;
         }
         if (matches == 0 && choice.contains("default")) {
-          spdlog::info("Selecting default choice for {}", c);
+          spdlog::info("Selecting default choice for {}", choice_name);
           if (choice["default"].contains("feature")) {
-            unprocessed_features.insert(choice["default"]["feature"].get<std::string>());
-            unprocessed_choices.erase(c);
+            const auto feature = choice["default"]["feature"].get<std::string>();
+            selected_features.insert(feature);
+            require_feature(feature, "choice:" + choice_name);
           } else if (choice["default"].contains("component")) {
-            unprocessed_components.insert(choice["default"]["component"].get<std::string>());
-            unprocessed_choices.erase(c);
+            const auto component = choice["default"]["component"].get<std::string>();
+            selected_components.insert(component);
+            require_component(component, "choice:" + choice_name);
           } else {
-            spdlog::error("Invalid default choice in {}", c);
+            spdlog::error("Invalid default choice in {}", choice_name);
             return project::state::PROJECT_HAS_INVALID_COMPONENT;
           }
-          break;
-        }
-      }
-    }
-
-    // Check if we have finished but we've come across replaced components
-    if (unprocessed_components.empty() && unprocessed_features.empty() && unprocessed_replacements.size() != 0) {
-      // move new replacements
-      for (const auto &[replacement, id]: unprocessed_replacements) {
-        spdlog::info("Adding {} to replaced_components", replacement);
-        // replaced_components.insert(replacement);
-        replacements.insert({ replacement, id });
+          c = unprocessed_choices.erase(c);
+        } else
+          ++c;
       }
-      unprocessed_replacements.clear();
-
-      // Restart the whole process
-      required_features.clear();
-      required_components.clear();
-      unprocessed_choices.clear();
-      unprocessed_components.clear();
-      unprocessed_features.clear();
-      components.clear();
-      project_summary["components"].clear();
-
-      // Set the initial state
-      for (const auto &c: initial_components)
-        unprocessed_components.insert(c);
-      for (const auto &f: initial_features)
-        unprocessed_features.insert(f);
-
-      spdlog::info("Start project processing again...");
     }
 
     // Check if we have finished but our project is using SLCC files
     if (unprocessed_components.empty() && unprocessed_features.empty() && component_flags != component_database::flag::IGNORE_ALL_SLC) {
-      // Find any features that aren't provided
+      // Find any features that aren't provided and add the components that can satisfy them
       std::unordered_set<std::string> temp_require_list = std::move(slc_required);
-      for (const auto &r: temp_require_list) {
-        if (slc_provided.contains(r))
-          continue;
-
-        // Check the databases
-        auto f = workspace.find_feature(r);
-        if (!f.has_value()) {
-          slc_required.insert(r);
-          continue;
-        }
-
-        auto feature_node = f.value();
-        std::unordered_set<std::string> recommended_options;
-        std::unordered_set<std::string> other_options;
-
-        // Go through possible options
-        for (const auto &option: feature_node) {
-          // Ignore if it is excluded
-          if (option.is_object() && (!condition_is_fulfilled(option) || is_disqualified_by_unless(option)))
-            continue;
-
-          const auto name = option.is_object() ? option["name"].get<std::string>() : option.get<std::string>();
-
-          // If this is recommended add to the recommended list, otherwise add to other options list
-          if (slc_recommended.contains(name)) {
-            if (condition_is_fulfilled(slc_recommended[name]) && !is_disqualified_by_unless(slc_recommended[name]))
-              recommended_options.insert(name);
-          } else {
-            other_options.insert(name);
-          }
-        }
-
-        // If there is more than 1 recommendation, the user must decide
-        // If there is a single recommendation, use that
-        // If there are no recommendations but only 1 option, use that
-        if (recommended_options.size() > 1) {
-          spdlog::error("Multiple recommendations for '{}'", r);
-          slc_required.insert(r);
-        } else if (recommended_options.size() == 1) {
-          const auto name           = *recommended_options.begin();
-          const auto recommend_node = slc_recommended[name];
-          spdlog::info("Adding recommended component '{}' to satisfy '{}'", name, r);
-          if (recommend_node.contains("instance")) {
-            for (const auto &i: recommend_node["instance"]) {
-              spdlog::info("Creating instance '{}' for '{}'", i.get<std::string>(), name);
-              instances.insert({ name, i.get<std::string>() });
-            }
-          }
-          // unprocessed_components.insert(name);
-          add_component(name, component_database::flag::ONLY_SLCC);
-        } else if (other_options.size() == 1) {
-          const auto name = *other_options.begin();
-          spdlog::info("Adding component '{}' to satisfy '{}'", name, r);
-          add_component(name, component_database::flag::ONLY_SLCC);
-          // unprocessed_components.insert(name);
-        } else {
-          slc_required.insert(r);
-        }
-      }
+      auto unresolved                                   = slc_resolver.resolve_project(std::move(temp_require_list), required_features, slc_provided, slc_recommended);
+      slc_required.merge(unresolved);
     }
 
     // Final check to see if Yakka component can provide an SLC requirement
@@ -554,6 +1008,8 @@ project::state project::evaluate_dependencies()
       break;
   }
 
+  spdlog::info("Dependency evaluation completed in {} iterations: {} components, {} features, {} retractions", evaluation_iterations, required_components.size(), required_features.size(), retraction_count);
+
   for (const auto &r: slc_required) {
     auto f = workspace.find_feature(r);
     if (f.has_value())
@@ -608,10 +1064,18 @@ void project::generate_project_summary()
   if (!project_summary.contains("tools"))
     project_summary["tools"] = nlohmann::json::object();
 
-  // Put all YAML nodes into the summary
+  // Move all component data into the summary. Later stages read it through component_json() so it isn't duplicated.
   for (const auto &c: components) {
-    project_summary["components"][c->id] = c->json;
-    for (auto &[key, value]: c->json["tools"].items()) {
+    auto &entry = project_summary["components"][c->id];
+    if (!c->json.is_null()) {
+      entry   = std::move(c->json);
+      c->json = nullptr;
+    }
+    summary_snapshot_stubs.erase(c->id);
+    const auto tools = entry.find("tools");
+    if (tools == entry.end())
+      continue;
+    for (auto &[key, value]: tools->items()) {
       inja::Environment inja_env = inja::Environment();
       inja_env.add_callback("curdir", 0, [&c](const inja::Arguments &args) {
         return std::filesystem::absolute(c->component_path).string();
@@ -621,8 +1085,17 @@ void project::generate_project_summary()
     }
   }
 
+  // Decode any components from the snapshot that are no longer part of the project but are still in the summary
+  for (const auto &name: summary_snapshot_stubs)
+    if (project_summary["components"].contains(name))
+      project_summary["components"][name] = nlohmann::json::from_cbor(summary_snapshot_components[name]);
+  summary_snapshot_stubs.clear();
+
+  // Features are sorted so an unchanged project produces an identical summary
+  std::vector<std::string> sorted_features(required_features.begin(), required_features.end());
+  std::sort(sorted_features.begin(), sorted_features.end());
   project_summary["features"] = {};
-  for (const auto &i: this->required_features)
+  for (const auto &i: sorted_features)
     project_summary["features"].push_back(i);
 
   project_summary["initial"]               = {};
@@ -636,6 +1109,8 @@ void project::generate_project_summary()
   project_summary["data"]         = nlohmann::json::object();
   project_summary["host"]         = nlohmann::json::object();
   project_summary["host"]["name"] = host_os_string;
+
+  aggregates.clear();
 }
 
 /**
@@ -655,12 +1130,12 @@ void project::process_blueprints()
 
 void project::generate_target_database()
 {
-  std::vector<std::string> new_targets;
-  std::unordered_set<std::string> processed_targets;
-  std::vector<std::string> unprocessed_targets;
+  std::vector<interned_string> new_targets;
+  std::unordered_set<interned_string> processed_targets;
+  std::vector<interned_string> unprocessed_targets;
 
   for (const auto &c: commands)
-    unprocessed_targets.push_back(c);
+    unprocessed_targets.push_back(intern(c));
 
   while (!unprocessed_targets.empty()) {
     for (const auto &t: unprocessed_targets) {
@@ -673,16 +1148,20 @@ void project::generate_target_database()
         continue;
 
       // Check if target is not in the database. Note task_database is a multimap
-      if (target_database.targets.find(t) == target_database.targets.end()) {
-        const auto match = blueprint_database.find_match(t, this->project_summary);
+      if (target_database.targets.find(t) == target_database.targets.end() && !target_database.leaves.contains(t)) {
+        render_blueprint_templates(t.view());
+        const auto match = blueprint_database.find_match(t.str(), this->project_summary, aggregates);
+        if (match.empty())
+          target_database.leaves.insert(t);
         for (const auto &m: match) {
           // Add an entry to the database
           target_database.targets.insert({ t, m });
 
-          // Check if the blueprint has additional requirements
-          if (m->blueprint->requirements.size() != 0)
+          // Load the components the blueprint requires the first time it matches
+          if (!m->blueprint->requirements_loaded) {
+            m->blueprint->requirements_loaded = true;
             for (const auto &t: m->blueprint->requirements) {
-              if (additional_tools.contains(t))
+              if (additional_tools.contains(t) || required_components.contains(t))
                 continue;
               const auto p = workspace.find_component(t);
               if (p.has_value()) {
@@ -690,6 +1169,7 @@ void project::generate_target_database()
                 this->add_additional_tool(component_path);
               }
             }
+          }
         }
       }
       auto tasks = target_database.targets.equal_range(t);
@@ -707,163 +1187,158 @@ void project::generate_target_database()
 
 void project::load_common_commands()
 {
-  blueprint_commands["echo"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["echo"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     if (!command.is_null())
-      captured_output = try_render(inja_env, command.get<std::string>(), generated_json);
+      input.text = try_render(inja_env, command.get<std::string>(), generated_json);
+    else
+      input_text(input);
 
-    spdlog::get("console")->info("{}", captured_output);
-    return { captured_output, 0 };
+    spdlog::get("console")->info("{}", input.text);
+    return { std::move(input.text), 0 };
   };
 
-  blueprint_commands["execute"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["execute"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     if (command.is_null())
       return { "", -1 };
     std::string temp = command.get<std::string>();
     try {
-      captured_output = inja_env.render(temp, generated_json);
-      //std::replace( captured_output.begin( ), captured_output.end( ), '/', '\\' );
-      spdlog::debug("Executing '{}'", captured_output);
-      auto [temp_output, retcode] = exec(captured_output, std::string(""));
+      const std::string command_line = inja_env.render(temp, generated_json);
+      //std::replace( command_line.begin( ), command_line.end( ), '/', '\\' );
+      spdlog::debug("Executing '{}'", command_line);
+      auto [temp_output, retcode] = exec(command_line, std::string(""));
 
       if (retcode != 0 && temp_output.length() != 0) {
-        spdlog::error("\n{} returned {}\n{}", captured_output, retcode, temp_output);
+        spdlog::error("\n{} returned {}\n{}", command_line, retcode, temp_output);
       } else if (temp_output.length() != 0)
         spdlog::info("{}", temp_output);
-      return { temp_output, retcode };
+      return { std::move(temp_output), retcode };
     } catch (std::exception &e) {
       spdlog::error("Failed to execute: {}\n{}", temp, e.what());
-      captured_output = "";
       return { "", -1 };
     }
   };
 
-  blueprint_commands["shell"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["shell"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     if (command.is_null())
       return { "", -1 };
     std::string temp = command.get<std::string>();
     try {
 #if defined(_WIN64) || defined(_WIN32) || defined(__CYGWIN__)
-      captured_output = "cmd /k \"" + inja_env.render(temp, generated_json) + "\"";
+      const std::string command_line = "cmd /k \"" + inja_env.render(temp, generated_json) + "\"";
 #else
-      captured_output = inja_env.render(temp, generated_json);
+      const std::string command_line = inja_env.render(temp, generated_json);
 #endif
-      spdlog::debug("Executing '{}' in a shell", captured_output);
-      auto [temp_output, retcode] = exec(captured_output, std::string(""));
+      spdlog::debug("Executing '{}' in a shell", command_line);
+      auto [temp_output, retcode] = exec(command_line, std::string(""));
 
       if (retcode != 0 && temp_output.length() != 0) {
-        spdlog::error("\n{} returned {}\n{}", captured_output, retcode, temp_output);
+        spdlog::error("\n{} returned {}\n{}", command_line, retcode, temp_output);
       } else if (temp_output.length() != 0)
         spdlog::info("{}", temp_output);
-      return { temp_output, retcode };
+      return { std::move(temp_output), retcode };
     } catch (std::exception &e) {
       spdlog::error("Failed to execute: {}\n{}", temp, e.what());
-      captured_output = "";
       return { "", -1 };
     }
   };
 
-  blueprint_commands["fix_slashes"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
-    std::replace(captured_output.begin(), captured_output.end(), '\\', '/');
-    return { captured_output, 0 };
+  blueprint_commands["fix_slashes"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    auto &text = input_text(input);
+    std::replace(text.begin(), text.end(), '\\', '/');
+    return { std::move(text), 0 };
   };
 
-  blueprint_commands["regex"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["regex"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     assert(command.contains("search"));
     std::regex regex_search(command["search"].get<std::string>());
+    // Matching runs over a view of the input so the remaining text isn't copied after every match
+    const std::string_view text = input_text(input);
+    std::match_results<std::string_view::const_iterator> sm;
+    std::string output;
     if (command.contains("split")) {
-      std::istringstream ss(captured_output);
-      std::string line;
-      captured_output = "";
+      nlohmann::json value = nlohmann::json::array();
+      for (size_t line_start = 0; line_start < text.size();) {
+        const size_t line_end       = std::min(text.find('\n', line_start), text.size());
+        const std::string_view line = text.substr(line_start, line_end - line_start);
+        line_start                  = line_end + 1;
 
-      while (std::getline(ss, line)) {
         if (command.contains("replace")) {
-          std::string r = std::regex_replace(line, regex_search, command["replace"].get<std::string>(), std::regex_constants::format_no_copy);
-          captured_output.append(r);
+          std::regex_replace(std::back_inserter(output), line.begin(), line.end(), regex_search, command["replace"].get<std::string>(), std::regex_constants::format_no_copy);
         } else if (command.contains("to_yaml")) {
-          std::smatch s;
-          if (!std::regex_match(line, s, regex_search))
+          if (!std::regex_match(line.begin(), line.end(), sm, regex_search))
             continue;
-          YAML::Node node;
-          node[0] = YAML::Node();
-          int i   = 1;
+          nlohmann::json item;
+          int i = 1;
           for (auto &v: command["to_yaml"])
-            node[0][v.get<std::string>()] = s[i++].str();
-
-          captured_output.append(YAML::Dump(node));
-          captured_output.append("\n");
+            item[v.get<std::string>()] = sm[i++].str();
+          value.push_back(std::move(item));
         }
       }
+      // The matches are passed on as structured data and only serialized as YAML if a following step needs text
+      if (command.contains("to_yaml") && !command.contains("replace"))
+        return { "", 0, std::move(value) };
     } else if (command.contains("to_yaml")) {
-      YAML::Node yaml;
-      for (std::smatch sm; std::regex_search(captured_output, sm, regex_search);) {
-        YAML::Node new_node;
+      nlohmann::json value = nlohmann::json::array();
+      for (auto remaining = text.begin(); std::regex_search(remaining, text.end(), sm, regex_search); remaining = sm.suffix().first) {
+        nlohmann::json item;
         int i = 1;
         for (auto &v: command["to_yaml"])
-          new_node[v.get<std::string>()] = sm[i++].str();
-        yaml.push_back(new_node);
-        captured_output = sm.suffix();
+          item[v.get<std::string>()] = sm[i++].str();
+        value.push_back(std::move(item));
       }
-
-      captured_output = YAML::Dump(yaml);
-      captured_output.append("\n");
+      // Without matches the text is the dump of an empty YAML node, as it was before the structured value was added
+      if (value.empty())
+        return { "\n", 0 };
+      return { "", 0, std::move(value) };
     } else if (command.contains("replace")) {
-      captured_output = std::regex_replace(captured_output, regex_search, command["replace"].get<std::string>());
+      std::regex_replace(std::back_inserter(output), text.begin(), text.end(), regex_search, command["replace"].get<std::string>());
     } else if (command.contains("match")) {
-      std::smatch sm;
-      std::string new_output      = command.contains("prefix") ? command["prefix"].get<std::string>() : "";
+      output                      = command.contains("prefix") ? command["prefix"].get<std::string>() : "";
       inja::Environment local_env = inja_env; // Create copy and override `$()` function
       const auto match_string     = command["match"].get<std::string>();
       local_env.add_callback("reg", 1, [&](const inja::Arguments &args) {
         return sm[args[0]->get<int>()].str();
       });
-      for (; std::regex_search(captured_output, sm, regex_search);) {
+      for (auto remaining = text.begin(); std::regex_search(remaining, text.end(), sm, regex_search); remaining = sm.suffix().first) {
         // Render the match template
-        new_output += try_render(local_env, match_string, generated_json);
-        captured_output = sm.suffix();
+        output += try_render(local_env, match_string, generated_json);
       }
       if (command.contains("suffix"))
-        new_output += command["suffix"].get<std::string>();
-      captured_output = new_output;
-      //captured_output = std::regex_replace(captured_output, regex_search, command["match"].get<std::string>(), std::regex_constants::format_no_copy);
+        output += command["suffix"].get<std::string>();
     } else {
       spdlog::error("'regex' command does not have enough information");
       return { "", -1 };
     }
-    return { captured_output, 0 };
+    return { std::move(output), 0 };
   };
 
-  blueprint_commands["inja"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["inja"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     try {
       std::string template_string;
       std::string template_filename;
       nlohmann::json data;
       if (command.is_string()) {
-        captured_output = try_render(inja_env, command.get<std::string>(), data.is_null() ? generated_json : data);
-        return { captured_output, 0 };
+        return { try_render(inja_env, command.get<std::string>(), data.is_null() ? generated_json : data), 0 };
       }
       if (command.is_object()) {
         if (command.contains("data_file")) {
           std::string data_filename = try_render(inja_env, command["data_file"].get<std::string>(), generated_json);
           YAML::Node data_yaml      = YAML::LoadFile(data_filename);
-          if (!data_yaml.IsNull())
-            data = data_yaml.as<nlohmann::json>();
+          data                      = data_yaml.IsNull() ? nlohmann::json{} : data_yaml.as<nlohmann::json>();
         } else if (command.contains("data")) {
           std::string data_string = try_render(inja_env, command["data"].get<std::string>(), generated_json);
           YAML::Node data_yaml    = YAML::Load(data_string);
-          if (!data_yaml.IsNull())
-            data = data_yaml.as<nlohmann::json>();
+          data                    = data_yaml.IsNull() ? nlohmann::json{} : data_yaml.as<nlohmann::json>();
         }
 
         if (command.contains("template_file")) {
           template_filename = try_render(inja_env, command["template_file"].get<std::string>(), generated_json);
-          captured_output   = try_render_file(inja_env, template_filename, data.is_null() ? generated_json : data);
-          return { captured_output, 0 };
+          return { try_render_file(inja_env, template_filename, data.is_null() ? generated_json : data), 0 };
         }
 
         if (command.contains("template")) {
           template_string = command["template"].get<std::string>();
-          captured_output = try_render(inja_env, template_string, data.is_null() ? generated_json : data);
-          return { captured_output, 0 };
+          return { try_render(inja_env, template_string, data.is_null() ? generated_json : data), 0 };
         }
       }
 
@@ -873,10 +1348,86 @@ void project::load_common_commands()
       spdlog::error("Failed to apply template: {}\n{}", command.dump(), e.what());
       return { "", -1 };
     }
-    return { captured_output, 0 };
   };
 
-  blueprint_commands["save"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  // Renders a Jinja template file in process. Templates are compiled once per run and the data file is parsed once per run, so the templates
+  // of an SLC project render on the task workers without starting a process or parsing template_contributions.json for each of them.
+  // Only the Jinja syntax described by jinja_template_cache is supported, anything else fails to render.
+  // Accepts an object with 'template_file' and 'data_file', or the '-t <template> -d <data>' arguments of the jinja tool.
+  blueprint_commands["jinja"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    try {
+      std::string template_filename;
+      std::string data_filename;
+      if (command.is_object()) {
+        if (command.contains("template_file"))
+          template_filename = try_render(inja_env, command["template_file"].get<std::string>(), generated_json);
+        if (command.contains("data_file"))
+          data_filename = try_render(inja_env, command["data_file"].get<std::string>(), generated_json);
+      } else if (command.is_string()) {
+        std::istringstream arguments(try_render(inja_env, command.get<std::string>(), generated_json));
+        for (std::string option; arguments >> option;) {
+          if (option == "-t")
+            arguments >> template_filename;
+          else if (option == "-d")
+            arguments >> data_filename;
+        }
+      }
+
+      if (template_filename.empty()) {
+        spdlog::error("'jinja' command requires a template file for {}", target);
+        return { "", -1 };
+      }
+      if (data_filename.empty())
+        return { get_jinja_template_cache().render(template_filename, generated_json), 0 };
+      return { get_jinja_template_cache().render(template_filename, *get_file_cache().load_json(data_filename)), 0 };
+    } catch (std::exception &e) {
+      spdlog::error("Failed to apply template: {}\n{}", command.dump(), e.what());
+      return { "", -1 };
+    }
+  };
+
+  // Copies a config file to the target replacing whole-word INSTANCE tokens with the instance name. The target is only written if its content changes.
+  blueprint_commands["instantiate"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    static auto &bytes_written = get_stat_counter("bytes written");
+    if (!command.is_object() || !command.contains("source")) {
+      spdlog::error("instantiate requires a 'source' for {}", target);
+      return { "", -1 };
+    }
+    const auto source   = try_render(inja_env, command["source"].get<std::string>(), generated_json);
+    const auto instance = command.contains("instance") ? try_render(inja_env, command["instance"].get<std::string>(), generated_json) : std::string{};
+
+    if (!fs::exists(source)) {
+      spdlog::error("Failed to read config file '{}'", source);
+      return { "", -1 };
+    }
+    std::string output = replace_whole_word(get_file_contents<std::string>(source), "INSTANCE", instance);
+
+    try {
+      if (fs::exists(target) && get_file_contents<std::string>(target) == output) {
+        update_process_stamp(target);
+        return { std::move(output), 0 };
+      }
+      fs::path p(target);
+      if (!p.parent_path().empty())
+        fs::create_directories(p.parent_path());
+      std::ofstream output_file(target, std::ios_base::binary);
+      output_file << output;
+      output_file.close();
+      bytes_written.add_amount(output.size());
+      get_file_cache().invalidate(target);
+      if (!output_file) {
+        spdlog::error("Failed to save file: '{}'", target);
+        return { "", -1 };
+      }
+    } catch (std::exception &e) {
+      spdlog::error("Failed to save file: '{}'", target);
+      return { "", -1 };
+    }
+    return { std::move(output), 0 };
+  };
+
+  blueprint_commands["save"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    static auto &bytes_written = get_stat_counter("bytes written");
     std::string save_filename;
 
     if (command.is_null())
@@ -894,17 +1445,27 @@ void project::load_common_commands()
         spdlog::error("Failed to save file: '{}'", save_filename);
         return { "", -1 };
       }
-      save_file << captured_output;
+      // Write straight from the step's buffer. Structured input is emitted directly to the file rather than through a string.
+      if (input.text.empty() && !input.value.empty()) {
+        YAML::Emitter emitter(save_file);
+        emitter << json_to_yaml(input.value);
+        save_file << "\n";
+        bytes_written.add_amount(emitter.size() + 1);
+      } else {
+        save_file.write(input.text.data(), input.text.size());
+        bytes_written.add_amount(input.text.size());
+      }
       save_file.flush();
       save_file.close();
+      get_file_cache().invalidate(save_filename);
     } catch (std::exception &e) {
       spdlog::error("Failed to save file: '{}'", save_filename);
       return { "", -1 };
     }
-    return { captured_output, 0 };
+    return { std::move(input.text), 0, std::move(input.value) };
   };
 
-  blueprint_commands["create_directory"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["create_directory"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     if (!command.is_null()) {
       std::string filename = "";
       try {
@@ -922,19 +1483,19 @@ void project::load_common_commands()
     return { "", 0 };
   };
 
-  blueprint_commands["verify"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["verify"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     std::string filename = command.get<std::string>();
     filename             = try_render(inja_env, filename, generated_json);
     if (fs::exists(filename)) {
       spdlog::info("{} exists", filename);
-      return { captured_output, 0 };
+      return { std::move(input.text), 0, std::move(input.value) };
     }
 
     spdlog::info("BAD!! {} doesn't exist", filename);
     return { "", -1 };
   };
 
-  blueprint_commands["rm"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["rm"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     std::string filename = command.get<std::string>();
     filename             = try_render(inja_env, filename, generated_json);
     // Check if the input was a YAML array construct
@@ -952,10 +1513,10 @@ void project::load_common_commands()
     } else {
       fs::remove(filename);
     }
-    return { captured_output, 0 };
+    return { std::move(input.text), 0, std::move(input.value) };
   };
 
-  blueprint_commands["rmdir"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["rmdir"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     std::string path = command.get<std::string>();
     path             = try_render(inja_env, path, generated_json);
     // Put some checks here
@@ -964,79 +1525,73 @@ void project::load_common_commands()
     if (!ec) {
       spdlog::error("'rmdir' command failed {}\n", ec.message());
     }
-    return { captured_output, 0 };
+    return { std::move(input.text), 0, std::move(input.value) };
   };
 
-  blueprint_commands["pack"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
-    std::vector<std::byte> data_output;
-
-    if (!command.contains("data")) {
-      spdlog::error("'pack' command requires 'data'\n");
+  // Packs numbers as binary. Values come from 'data', a list of numbers or templates, and 'data_file', a YAML or JSON array. 'binary_file' is appended as is.
+  blueprint_commands["pack"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    if (!command.contains("data") && !command.contains("data_file") && !command.contains("binary_file")) {
+      spdlog::error("'pack' command requires 'data', 'data_file' or 'binary_file'\n");
       return { "", -1 };
     }
 
-    if (!command.contains("format")) {
+    if ((command.contains("data") || command.contains("data_file")) && !command.contains("format")) {
       spdlog::error("'pack' command requires 'format'\n");
       return { "", -1 };
     }
 
-    std::string format = command["format"].get<std::string>();
-    format             = try_render(inja_env, format, generated_json);
-
-    auto i = format.begin();
-    for (auto d: command["data"]) {
-      auto v       = try_render(inja_env, d.get<std::string>(), generated_json);
-      const char c = *i++;
-      union {
-        int8_t s8;
-        uint8_t u8;
-        int16_t s16;
-        uint16_t u16;
-        int32_t s32;
-        uint32_t u32;
-        unsigned long value;
-        std::byte bytes[8];
-      } temp;
-      const auto result = (v.size() > 1 && v[1] == 'x') ? std::from_chars(v.data() + 2, v.data() + v.size(), temp.u32, 16)
-                          : (v[0] == '-')               ? std::from_chars(v.data(), v.data() + v.size(), temp.s32)
-                                                        : std::from_chars(v.data(), v.data() + v.size(), temp.u32);
-      if (result.ec != std::errc()) {
-        spdlog::error("Error converting number: {}\n", v);
+    auto render = [&](const std::string &text) {
+      return has_template_markup(text) ? try_render(inja_env, text, generated_json) : text;
+    };
+
+    std::vector<uint64_t> values;
+    auto add_value = [&](const nlohmann::json &node) {
+      uint64_t value    = 0;
+      const bool parsed = node.is_string() ? parse_pack_value(std::string_view{ render(node.get<std::string>()) }, value) : parse_pack_value(node, value);
+      if (!parsed)
+        spdlog::error("Error converting number: {}\n", node.dump());
+      values.push_back(value);
+    };
+
+    try {
+      if (command.contains("data")) {
+        values.reserve(command["data"].size());
+        for (const auto &d: command["data"])
+          add_value(d);
       }
 
-      switch (c) {
-        case 'L':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[4]);
-          break;
-        case 'l':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[4]);
-          break;
-        case 'S':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[2]);
-          break;
-        case 's':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[2]);
-          break;
-        case 'C':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[1]);
-          break;
-        case 'c':
-          data_output.insert(data_output.end(), &temp.bytes[0], &temp.bytes[1]);
-          break;
-        case 'x':
-          data_output.push_back(std::byte{ 0 });
-          break;
-        default:
-          spdlog::error("Unknown pack type\n");
-          break;
+      if (command.contains("data_file")) {
+        const fs::path data_file = render(command["data_file"].get<std::string>());
+        const auto data          = data_file.extension() == ".json" ? get_file_cache().load_json(data_file) : get_file_cache().load_yaml(data_file);
+        if (!data->is_array()) {
+          spdlog::error("'pack' data file '{}' does not contain an array\n", data_file.generic_string());
+          return { "", -1 };
+        }
+        values.reserve(values.size() + data->size());
+        for (const auto &d: *data) {
+          uint64_t value = 0;
+          if (!parse_pack_value(d, value))
+            spdlog::error("Error converting number: {}\n", d.dump());
+          values.push_back(value);
+        }
+      }
+
+      auto &output = input_text(input);
+      if (!values.empty())
+        pack_format::get(render(command["format"].get<std::string>()))->pack(values, output);
+
+      if (command.contains("binary_file")) {
+        const auto contents = get_file_cache().read(render(command["binary_file"].get<std::string>()))->view();
+        output.append(contents.data(), contents.size());
       }
+      return { std::move(output), 0 };
+    } catch (std::exception &e) {
+      spdlog::error("'pack' command failed while processing {}: {}\n", target, e.what());
+      return { "", -1 };
     }
-    auto *chars = reinterpret_cast<char const *>(data_output.data());
-    captured_output.insert(captured_output.end(), chars, chars + data_output.size());
-    return { captured_output, 0 };
   };
 
-  blueprint_commands["copy"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["copy"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     std::string destination;
     nlohmann::json source;
     try {
@@ -1058,43 +1613,47 @@ void project::load_common_commands()
           return { "", -1 };
         }
       }
+      // Only entries with template markup are rendered
+      auto render_entry = [&](const nlohmann::json &entry) {
+        auto entry_string = entry.get<std::string>();
+        return has_template_markup(entry_string) ? try_render(inja_env, entry_string, generated_json) : entry_string;
+      };
+
+      // Plan every copy before running them in parallel
+      yakka::copy_engine copier;
       if (source.is_string()) {
-        auto source_string = try_render(inja_env, source.get<std::string>(), generated_json);
-        std::filesystem::copy(source_string, destination, std::filesystem::copy_options::recursive | std::filesystem::copy_options::update_existing);
+        copier.add(render_entry(source), destination, true);
       } else if (source.is_array()) {
-        for (const auto &f: source) {
-          auto source_string = try_render(inja_env, f.get<std::string>(), generated_json);
-          std::filesystem::copy(source_string, destination, std::filesystem::copy_options::recursive | std::filesystem::copy_options::update_existing);
-        }
+        for (const auto &f: source)
+          copier.add(render_entry(f), destination, true);
       } else if (source.is_object()) {
         if (source.contains("folder_paths"))
           for (const auto &f: source["folder_paths"]) {
-            auto source_string = try_render(inja_env, f.get<std::string>(), generated_json);
-            auto dest          = destination + "/" + source_string;
-            std::filesystem::create_directories(dest);
-            std::filesystem::copy(source_string, dest, std::filesystem::copy_options::recursive | std::filesystem::copy_options::update_existing);
+            auto source_string = render_entry(f);
+            copier.add(source_string, destination + "/" + source_string, true);
           }
         if (source.contains("folders"))
-          for (const auto &f: source["folders"]) {
-            auto source_string = try_render(inja_env, f.get<std::string>(), generated_json);
-            std::filesystem::copy(source_string, destination, std::filesystem::copy_options::recursive | std::filesystem::copy_options::update_existing);
-          }
+          for (const auto &f: source["folders"])
+            copier.add(render_entry(f), destination, true);
         if (source.contains("file_paths"))
           for (const auto &f: source["file_paths"]) {
-            auto source_string         = try_render(inja_env, f.get<std::string>(), generated_json);
-            std::filesystem::path dest = destination + "/" + source_string;
-            std::filesystem::create_directories(dest.parent_path());
-            std::filesystem::copy(source_string, dest, std::filesystem::copy_options::update_existing);
+            auto source_string = render_entry(f);
+            copier.add(source_string, destination + "/" + source_string, false);
           }
         if (source.contains("files"))
-          for (const auto &f: source["files"]) {
-            auto source_string = try_render(inja_env, f.get<std::string>(), generated_json);
-            std::filesystem::copy(source_string, destination, std::filesystem::copy_options::update_existing);
-          }
+          for (const auto &f: source["files"])
+            copier.add(render_entry(f), destination, false);
       } else {
         spdlog::error("'copy' command missing 'source' or 'list' while processing {}", target);
         return { "", -1 };
       }
+
+      const auto result = copier.run();
+      for (const auto &error: result.errors)
+        spdlog::error("'copy' command failed while processing {}: {}", target, error);
+      if (!result.errors.empty())
+        return { "", -1 };
+      spdlog::info("{}: copied {} files ({} bytes), skipped {} identical files", target, result.copied_files, result.copied_bytes, result.skipped_files);
     } catch (std::exception &e) {
       spdlog::error("'copy' command failed while processing {}: '{}' -> '{}'\r\n{}", target, source.dump(), destination, e.what());
       return { "", -1 };
@@ -1102,34 +1661,34 @@ void project::load_common_commands()
     return { "", 0 };
   };
 
-  blueprint_commands["cat"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["cat"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     std::string filename = try_render(inja_env, command.get<std::string>(), generated_json);
-    std::ifstream datafile;
-    datafile.open(filename, std::ios_base::in | std::ios_base::binary);
-    std::stringstream string_stream;
-    string_stream << datafile.rdbuf();
-    captured_output = string_stream.str();
-    datafile.close();
-    return { captured_output, 0 };
+    try {
+      return { std::string{ get_file_cache().read(filename)->view() }, 0 };
+    } catch (std::exception &e) {
+      return { "", 0 };
+    }
   };
 
-  blueprint_commands["new_project"] = [this](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["new_project"] = [this](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     const auto project_string = command.get<std::string>();
     yakka::project new_project(project_string, workspace);
     new_project.init_project(project_string);
     return { "", 0 };
   };
 
-  blueprint_commands["as_json"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
-    const auto temp_json = nlohmann::json::parse(captured_output);
+  blueprint_commands["as_json"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    if (input.text.empty() && !input.value.empty())
+      return { input.value.dump(2), 0 };
+    const auto temp_json = nlohmann::json::parse(input.text);
     return { temp_json.dump(2), 0 };
   };
 
-  blueprint_commands["as_yaml"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
-    const auto temp_yaml = YAML::Load(captured_output);
+  blueprint_commands["as_yaml"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+    const auto temp_yaml = YAML::Load(input_text(input));
     return { YAML::Dump(temp_yaml), 0 };
   };
-  blueprint_commands["diff"] = [](std::string target, const nlohmann::json &command, std::string captured_output, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
+  blueprint_commands["diff"] = [](const std::string &target, const nlohmann::json &command, yakka::process_data &&input, const nlohmann::json &generated_json, inja::Environment &inja_env) -> yakka::process_return {
     if (!command.is_object()) {
       spdlog::error("'diff' command invalid");
       return { "", -1 };
@@ -1138,16 +1697,14 @@ void project::load_common_commands()
     nlohmann::json right;
     if (command.contains("left_file")) {
       const fs::path left_file = try_render(inja_env, command["left_file"].get<std::string>(), generated_json);
-      std::ifstream ifs(left_file);
-      left = nlohmann::json::parse(ifs);
+      left                     = *get_file_cache().load_json(left_file);
     } else if (command.contains("left")) {
       left = try_render(inja_env, command["left"].get<std::string>(), generated_json);
     }
 
     if (command.contains("right_file")) {
       const fs::path right_file = try_render(inja_env, command["right_file"].get<std::string>(), generated_json);
-      std::ifstream ifs(right_file);
-      right = nlohmann::json::parse(ifs);
+      right                     = *get_file_cache().load_json(right_file);
     } else if (command.contains("right")) {
       right = try_render(inja_env, command["right"].get<std::string>(), generated_json);
     }
@@ -1159,13 +1716,33 @@ void project::load_common_commands()
 
 void project::create_tasks(const std::string target_name, tf::Task &parent)
 {
+  create_tasks(intern(target_name), parent);
+}
+
+/**
+ * @brief Returns the time a target was built. Commands such as 'instantiate' leave a target untouched when its content is unchanged,
+ *        so the timestamp of the file is used when there is one and targets that depend on it aren't rebuilt.
+ */
+static fs::file_time_type built_time(std::string_view target_name)
+{
+  return timed_exists(target_name) ? timed_last_write_time(target_name) : fs::file_time_type::clock::now();
+}
+
+void project::create_tasks(interned_string target, tf::Task &parent)
+{
+  // The interned text lives for the whole run so tasks capture the view rather than a copy
+  const std::string_view target_name = target.view();
+  static auto &created_stats  = get_stat_counter("tasks created");
+  static auto &executed_stats = get_stat_counter("tasks executed");
+  static auto &skipped_stats  = get_stat_counter("tasks skipped");
+
   // XXX: Start time should be determined at the start of the executable and not here
   auto start_time = fs::file_time_type::clock::now();
 
   //spdlog::info("Create tasks for: {}", target_name);
 
   // Check if this target has already been processed
-  const auto &existing_todo = todo_list.equal_range(target_name);
+  const auto &existing_todo = todo_list.equal_range(target);
   if (existing_todo.first != existing_todo.second) {
     // Add parent to the dependency graph
     for (auto i = existing_todo.first; i != existing_todo.second; ++i)
@@ -1176,31 +1753,38 @@ void project::create_tasks(const std::string target_name, tf::Task &parent)
   }
 
   // Get targets that match the name
-  const auto &targets = target_database.targets.equal_range(target_name);
+  const auto &targets = target_database.targets.equal_range(target);
 
   // If there is no targets then it must be a leaf node (source file, data dependency, etc)
   if (targets.first == targets.second) {
     //spdlog::info("{}: leaf node", target_name);
-    auto new_todo = todo_list.insert(std::make_pair(target_name, construction_task()));
+    auto new_todo = todo_list.insert(std::make_pair(target, construction_task()));
     auto task     = taskflow.placeholder();
+    created_stats.increment();
 
     // Check if target is a data dependency
     if (target_name.front() == data_dependency_identifier) {
+      // Decode the previous values of the components it refers to before the task runs
+      if (target_name.size() > 2 && target_name[2] == data_wildcard_identifier) {
+        for (const auto &[name, data]: summary_snapshot_components)
+          load_previous_summary_component(name);
+      } else if (target_name.size() > 2)
+        load_previous_summary_component(std::string(target_name.substr(2, target_name.find_first_of('/', 2) - 2)));
       task.data(&new_todo->second).work([=, this]() {
         // spdlog::info("{}: data", target_name);
         auto *d          = static_cast<construction_task *>(task.data());
-        d->last_modified = has_data_dependency_changed(target_name, previous_summary, project_summary) ? fs::file_time_type::max() : fs::file_time_type::min();
+        d->last_modified = has_data_dependency_changed(std::string(target_name), previous_summary, project_summary) ? fs::file_time_type::max() : fs::file_time_type::min();
         if (d->last_modified > start_time)
           spdlog::info("{} has been updated", target_name);
         return;
       });
     }
     // Check if target name matches an existing file in filesystem
-    else if (fs::exists(target_name)) {
+    else if (timed_exists(target_name)) {
       // Create a new task to retrieve the file timestamp
-      task.data(&new_todo->second).work([=]() {
+      task.data(&new_todo->second).work([=, this]() {
         auto *d          = static_cast<construction_task *>(task.data());
-        d->last_modified = fs::last_write_time(target_name);
+        d->last_modified = leaf_timestamp_handler ? leaf_timestamp_handler(target_name) : timed_last_write_time(target_name);
         //spdlog::info("{}: timestamp {}", target_name, (uint)d->last_modified.time_since_epoch().count());
         return;
       });
@@ -1215,22 +1799,24 @@ void project::create_tasks(const std::string target_name, tf::Task &parent)
   for (auto i = targets.first; i != targets.second; ++i) {
     // spdlog::info("{}: Not a leaf node", target_name);
     // ++work_task_count;
-    auto new_todo          = todo_list.insert(std::make_pair(target_name, construction_task()));
-    new_todo->second.match = i->second;
+    // The recursive calls below can rehash the todo list, which invalidates iterators but not references
+    auto &new_todo = todo_list.insert(std::make_pair(target, construction_task()))->second;
+    new_todo.match = i->second;
     if (i->second->blueprint->task_group.empty()) {
-      new_todo->second.group = todo_task_groups["Processing"];
+      new_todo.group = todo_task_groups["Processing"];
     } else {
       if (todo_task_groups.contains(i->second->blueprint->task_group))
-        new_todo->second.group = todo_task_groups[i->second->blueprint->task_group];
+        new_todo.group = todo_task_groups[i->second->blueprint->task_group];
       else {
-        new_todo->second.group                             = std::make_shared<yakka::task_group>(i->second->blueprint->task_group);
-        todo_task_groups[i->second->blueprint->task_group] = new_todo->second.group;
+        new_todo.group                                     = std::make_shared<yakka::task_group>(i->second->blueprint->task_group);
+        todo_task_groups[i->second->blueprint->task_group] = new_todo.group;
       }
     }
-    ++new_todo->second.group->total_count;
+    ++new_todo.group->total_count;
 
     auto task = taskflow.placeholder();
-    task.data(&new_todo->second).work([=, this]() {
+    created_stats.increment();
+    task.data(&new_todo).work([=, this]() {
       if (abort_build)
         return;
       // spdlog::info("{}: process --- {}", target_name, task.hash_value());
@@ -1240,27 +1826,37 @@ void project::create_tasks(const std::string target_name, tf::Task &parent)
         spdlog::info("{} already done", target_name);
         return;
       }
-      if (fs::exists(target_name)) {
-        d->last_modified = fs::last_write_time(target_name);
+      const bool target_exists = timed_exists(target_name);
+      if (target_exists) {
+        d->last_modified = timed_last_write_time(target_name);
         // spdlog::info("{}: timestamp {}", target_name, (uint)d->last_modified.time_since_epoch().count());
       }
       if (d->match) {
         // Check if there are no dependencies
         if (d->match->dependencies.size() == 0) {
           // If it doesn't exist as a file, run the command
-          if (!fs::exists(target_name)) {
-            auto result      = yakka::run_command(i->first, d, this);
-            d->last_modified = fs::file_time_type::clock::now();
+          if (!target_exists) {
+            executed_stats.increment();
+            auto result      = yakka::run_command(target.str(), d, this);
+            d->last_modified = built_time(target_name);
             if (result.second != 0) {
               spdlog::info("Aborting: {} returned {}", target_name, result.second);
               abort_build = true;
               return;
             }
+          } else {
+            skipped_stats.increment();
           }
         } else if (!d->match->blueprint->process.is_null()) {
           auto max_element = todo_list.end();
           for (auto j: d->match->dependencies) {
-            auto temp         = todo_list.equal_range(j);
+            auto temp = todo_list.equal_range(j);
+            // Every dependency gets a task before its dependents, so a missing one means the task graph is broken
+            if (temp.first == temp.second) {
+              spdlog::error("Aborting: {} depends on {} which has no task", target_name, j.view());
+              abort_build = true;
+              return;
+            }
             auto temp_element = std::max_element(temp.first, temp.second, [](auto const &i, auto const &j) {
               return i.second.last_modified < j.second.last_modified;
             });
@@ -1270,15 +1866,20 @@ void project::create_tasks(const std::string target_name, tf::Task &parent)
             }
           }
           //spdlog::info("{}: Max element is {}", target_name, max_element->first);
-          if (!fs::exists(target_name) || max_element->second.last_modified.time_since_epoch() > d->last_modified.time_since_epoch()) {
+          // A target that is older than a dependency is still up to date if its process ran after the dependency changed and left it untouched
+          const auto newest_dependency = max_element->second.last_modified;
+          if (!target_exists || (newest_dependency > d->last_modified && !processed_since(target_name, newest_dependency))) {
+            executed_stats.increment();
             spdlog::info("{}: Updating because of {}", target_name, max_element->first);
-            auto [output, retcode] = yakka::run_command(i->first, d, this);
-            d->last_modified       = fs::file_time_type::clock::now();
+            auto [output, retcode] = yakka::run_command(target.str(), d, this);
+            d->last_modified       = built_time(target_name);
             if (retcode < 0) {
               spdlog::info("Aborting: {} returned {}", target_name, retcode);
               abort_build = true;
               return;
             }
+          } else {
+            skipped_stats.increment();
           }
         } else {
           //spdlog::info("{} has no process", target_name);
@@ -1292,32 +1893,122 @@ void project::create_tasks(const std::string target_name, tf::Task &parent)
       return;
     });
 
-    new_todo->second.task = task;
-    new_todo->second.task.precede(parent);
+    new_todo.task = task;
+    new_todo.task.precede(parent);
 
     // For each dependency described in blueprint, retrieve or create task, add relationship, and add item to todo list
     if (i->second)
-      for (auto &dep_target: i->second->dependencies)
-        create_tasks(dep_target.starts_with("./") ? dep_target.substr(dep_target.find_first_not_of("/", 2)) : dep_target, new_todo->second.task);
+      for (const auto &dep_target: i->second->dependencies)
+        create_tasks(dep_target.view().starts_with("./") ? intern(strip_current_directory(dep_target.view())) : dep_target, new_todo.task);
     // else
     //     spdlog::info("{} does not have blueprint match", i->first);
   }
 }
 
 /**
-     * @brief Save to disk the content of the @ref project_summary to yakka_summary.yaml and yakka_summary.json
+ * @brief Prepares the task graph to be run again. Timestamps are cleared so every task re-evaluates its target.
+ */
+void project::reset_tasks()
+{
+  abort_build = false;
+  for (auto &[name, todo]: todo_list)
+    todo.last_modified = fs::file_time_type::min();
+  for (auto &[name, group]: todo_task_groups) {
+    group->current_count        = 0;
+    group->last_progress_update = 0;
+  }
+}
+
+/**
+ * @brief Removes the task graph so it can be created again from the target database
+ */
+void project::clear_tasks()
+{
+  todo_list.clear();
+  todo_task_groups.clear();
+  taskflow.clear();
+}
+
+/**
+     * @brief Save to disk the content of the @ref project_summary to yakka_summary.cbor and yakka_summary.json
+     *        Neither file is written if the snapshot is unchanged. The JSON file is also recreated if it has been removed.
      *
      */
 void project::save_summary()
 {
-  if (!fs::exists(project_summary["project_output"].get<std::string>()))
-    fs::create_directories(project_summary["project_output"].get<std::string>());
+  const auto output_directory = project_summary["project_output"].get<std::string>();
+  if (!fs::exists(output_directory))
+    fs::create_directories(output_directory);
+
+  save_template_contributions();
+
+  // Store each component as a separate CBOR byte string so loading the snapshot doesn't decode them
+  auto summary_components       = std::move(project_summary["components"]);
+  project_summary["components"] = nlohmann::json::object();
+  for (const auto &[name, value]: summary_components.items()) {
+    auto &entry = project_summary["components"][name];
+    entry       = nlohmann::json::object();
+    if (value.contains("yakka_file"))
+      entry["yakka_file"] = value["yakka_file"];
+    entry["data"] = nlohmann::json::binary(nlohmann::json::to_cbor(value));
+  }
+  std::string snapshot;
+  nlohmann::json::to_cbor(project_summary, snapshot);
+  project_summary["components"] = std::move(summary_components);
+
+  const auto snapshot_hash = std::hash<std::string>{}(snapshot);
+  if (snapshot_hash != project_summary_snapshot_hash || !fs::exists(output_directory + "/yakka_summary.cbor")) {
+    std::ofstream snapshot_file(output_directory + "/yakka_summary.cbor", std::ios::binary);
+    snapshot_file.write(snapshot.data(), snapshot.size());
+    snapshot_file.close();
+    project_summary_snapshot_hash = snapshot_hash;
+
+    std::ofstream json_file(output_directory + "/yakka_summary.json");
+    json_file << project_summary.dump(3);
+    json_file.close();
+  } else {
+    // Component files are compared against the snapshot time so it must advance even when the content is unchanged
+    fs::last_write_time(output_directory + "/yakka_summary.cbor", fs::file_time_type::clock::now());
+    if (!fs::exists(output_directory + "/yakka_summary.json")) {
+      std::ofstream json_file(output_directory + "/yakka_summary.json");
+      json_file << project_summary.dump(3);
+      json_file.close();
+    }
+  }
+}
+
+/**
+ * @brief Saves the template contributions as a single file used to render templates and as a file per contribution name used as dependencies.
+ *        A hash of each contribution is kept in the project summary and a file is only rewritten when its hash changes.
+ *        Names that are no longer contributed are written as an empty list so templates that referenced them are rebuilt.
+ */
+void project::save_template_contributions()
+{
+  const auto output_directory = project_summary["project_output"].get<std::string>();
+  const auto previous_hashes  = project_summary.contains("template_contribution_hashes") ? project_summary["template_contribution_hashes"] : nlohmann::json::object();
+  nlohmann::json hashes       = nlohmann::json::object();
+
+  auto save_contribution = [&](const std::string &name, const nlohmann::json &value) {
+    const auto text     = value.dump(3);
+    const auto hash     = std::hash<std::string>{}(text);
+    const auto filename = output_directory + "/template_contributions/" + name + ".json";
+    hashes[name]        = hash;
+    if (previous_hashes.contains(name) && previous_hashes[name] == hash && fs::exists(filename))
+      return;
+
+    fs::create_directories(output_directory + "/template_contributions");
+    std::ofstream file(filename, std::ios::binary);
+    file << text;
+  };
 
-  std::ofstream json_file(project_summary["project_output"].get<std::string>() + "/yakka_summary.json");
-  json_file << project_summary.dump(3);
-  json_file.close();
+  for (const auto &[name, value]: template_contributions.items())
+    save_contribution(name, value);
+  for (const auto &[name, value]: previous_hashes.items())
+    if (!hashes.contains(name))
+      save_contribution(name, nlohmann::json::array());
+  project_summary["template_contribution_hashes"] = hashes;
 
-  std::string template_contribution_filename = project_summary["project_output"].get<std::string>() + "/template_contributions.json";
+  std::string template_contribution_filename = output_directory + "/template_contributions.json";
   // Check if template contribution file exists
   if (fs::exists(template_contribution_filename)) {
     // Read the content and compare to the current value, only rewrite if content is different
@@ -1332,6 +2023,269 @@ void project::save_summary()
   std::ofstream template_contributions_file(template_contribution_filename);
   template_contributions_file << template_contributions.dump(3);
   template_contributions_file.close();
+  get_file_cache().invalidate(template_contribution_filename);
+}
+
+// Returns the timestamp and size of a file, or nothing if it doesn't exist
+static std::optional<std::pair<int64_t, uintmax_t>> file_stamp(const fs::path &path)
+{
+  std::error_code error;
+  const auto last_modified = fs::last_write_time(path, error);
+  if (error)
+    return {};
+  const auto size = fs::is_directory(path, error) ? 0 : fs::file_size(path, error);
+  if (error)
+    return {};
+  return std::make_pair(static_cast<int64_t>(last_modified.time_since_epoch().count()), size);
+}
+
+/**
+ * @brief Parses a component file, reusing the result from the resolution snapshot if the file hasn't changed
+ */
+yakka_status project::parse_component(std::shared_ptr<yakka::component> component, const fs::path &file_path, const fs::path &package_path)
+{
+  static auto &cache_stats = get_stat_counter("component cache hit");
+  const auto key           = file_path.generic_string();
+  const auto stamp         = file_stamp(file_path);
+
+  const auto cached = component_cache.find(key);
+  if (stamp && cached != component_cache.end() && cached->second.last_modified == stamp->first && cached->second.size == stamp->second && cached->second.package_path == package_path.generic_string()) {
+    cache_stats.increment();
+    cached->second.used       = true;
+    component->file_path      = file_path;
+    component->package_path   = package_path;
+    component->id             = cached->second.id;
+    component->component_path = cached->second.component_path;
+    component->type           = static_cast<decltype(component->type)>(cached->second.type);
+    component->json           = nlohmann::json::from_cbor(cached->second.json);
+    return yakka_status::SUCCESS;
+  }
+
+  const auto status = component->parse_file(file_path, package_path);
+  if (status == yakka_status::SUCCESS && stamp)
+    component_cache.insert_or_assign(key, cached_component{ component->id, package_path.generic_string(), component->component_path.generic_string(), component->type, stamp->first, stamp->second, nlohmann::json::to_cbor(component->json), true });
+  return status;
+}
+
+/**
+ * @brief Restores the resolved project from yakka_resolution.cbor written by @ref save_resolution_snapshot.
+ *        The snapshot is used if the command line, component flags, workspace configuration and component databases are the same and none of the component files parsed
+ *        during the resolution have changed. This includes components that were replaced.
+ *        There is no partial re-resolution. Any miss means the whole dependency and choice resolution is run again.
+ *        The only work saved on a miss is parsing: the parsed component files are loaded in either case, so only changed files are parsed again.
+ *        The summary must also hold every component, as @ref update_summary empties the components that are newer than it.
+ *        The template and config files read by @ref process_slc_rules must also be unchanged.
+ *        Must be called after @ref init_project and before @ref evaluate_dependencies.
+ * @return true if the resolution steps up to and including @ref validate_schema can be skipped
+ */
+bool project::load_resolution_snapshot()
+{
+  static auto &stats = get_stat_counter("resolution snapshot");
+  scoped_stat_timer timer(stats);
+
+  // The key is kept so the snapshot can be saved once the project is resolved
+  std::vector<std::string> with(slc_required.begin(), slc_required.end());
+  std::sort(with.begin(), with.end());
+  resolution_key                  = nlohmann::json::object();
+  resolution_key["components"]    = initial_components;
+  resolution_key["features"]      = initial_features;
+  resolution_key["with"]          = with;
+  resolution_key["flags"]         = static_cast<int>(component_flags);
+  resolution_key["configuration"] = workspace.configuration_json;
+  resolution_key["databases"]     = nlohmann::json::array();
+
+  std::vector<fs::path> database_paths = { workspace.local_database.get_path(), workspace.shared_database.get_path() };
+  for (const auto &db: workspace.package_databases)
+    database_paths.push_back(db.get_path());
+  for (const auto &p: database_paths) {
+    const auto database_file = (p / "yakka-components.json").generic_string();
+    const auto stamp         = file_stamp(database_file);
+    if (stamp)
+      resolution_key["databases"].push_back({ database_file, stamp->first, stamp->second });
+  }
+
+  if (!fs::exists(project_resolution_file))
+    return false;
+
+  nlohmann::json snapshot;
+  try {
+    snapshot = nlohmann::json::from_cbor(yakka::get_file_contents<std::string>(project_resolution_file));
+  } catch (std::exception &e) {
+    spdlog::info("Ignoring resolution snapshot '{}'\n{}", project_resolution_file, e.what());
+    return false;
+  }
+  if (snapshot.value("version", 0) != 2)
+    return false;
+
+  bool unchanged = true;
+  std::unordered_map<std::string, const nlohmann::json *> files;
+  for (auto &entry: snapshot["files"]) {
+    const auto file  = entry["file"].get<std::string>();
+    files[file]      = &entry;
+    const auto stamp = file_stamp(file);
+    if (!stamp || stamp->first != entry["last_modified"].get<int64_t>() || stamp->second != entry["size"].get<uintmax_t>()) {
+      spdlog::info("{} has changed since the project was resolved", file);
+      unchanged = false;
+      continue;
+    }
+    component_cache.insert_or_assign(file, cached_component{ entry["id"].get<std::string>(), entry["package_path"].get<std::string>(), entry["component_path"].get<std::string>(), entry["type"].get<int>(), stamp->first, stamp->second, std::move(entry["json"].get_binary()), false });
+  }
+
+  // SLCE component paths are searched for components so a new file in one of the directories changes the project
+  for (const auto &d: snapshot["directories"]) {
+    const auto stamp = file_stamp(d[0].get<std::string>());
+    if (!stamp || stamp->first != d[1].get<int64_t>()) {
+      spdlog::info("{} has changed since the project was resolved", d[0].get<std::string>());
+      unchanged = false;
+    }
+  }
+
+  // The template and config files read by process_slc_rules(). Files without a stamp were missing.
+  for (const auto &i: snapshot["inputs"]) {
+    const auto stamp = file_stamp(i[0].get<std::string>());
+    if (stamp ? i.size() != 3 || stamp->first != i[1].get<int64_t>() || stamp->second != i[2].get<uintmax_t>() : i.size() != 1) {
+      spdlog::info("{} has changed since the project was resolved", i[0].get<std::string>());
+      unchanged = false;
+    }
+  }
+
+  if (!unchanged || snapshot["key"] != resolution_key || snapshot["summary_hash"].get<size_t>() != project_summary_snapshot_hash || !fs::exists(project_summary_file))
+    return false;
+
+  // update_summary() empties the entries of components that are newer than the summary so they must be processed again
+  for (const auto &file: snapshot["components"]) {
+    const auto id = (*files.at(file.get<std::string>()))["id"].get<std::string>();
+    if (!project_summary["components"].contains(id) || project_summary["components"][id].is_null()) {
+      spdlog::info("{} has changed since the project summary was saved", id);
+      return false;
+    }
+  }
+
+  spdlog::info("Using the resolved project from {}", project_resolution_file);
+  components.clear();
+  for (const auto &file: snapshot["components"]) {
+    const auto &entry = *files.at(file.get<std::string>());
+    auto c            = std::make_shared<yakka::component>();
+    c->file_path      = entry["file"].get<std::string>();
+    c->package_path   = entry["package_path"].get<std::string>();
+    c->component_path = entry["component_path"].get<std::string>();
+    c->id             = entry["id"].get<std::string>();
+    c->type           = static_cast<decltype(c->type)>(entry["type"].get<int>());
+    c->json           = nullptr;
+    components.push_back(c);
+  }
+
+  // The component data is held by the summary
+  for (const auto &name: summary_snapshot_stubs)
+    if (project_summary["components"].contains(name))
+      project_summary["components"][name] = nlohmann::json::from_cbor(summary_snapshot_components[name]);
+  summary_snapshot_stubs.clear();
+
+  required_components.clear();
+  for (const auto &c: snapshot["required_components"])
+    required_components.insert(c.get<std::string>());
+  required_features.clear();
+  for (const auto &f: snapshot["required_features"])
+    required_features.insert(f.get<std::string>());
+  instances.clear();
+  for (const auto &i: snapshot["instances"])
+    instances.insert({ i[0].get<std::string>(), i[1].get<std::string>() });
+  unprocessed_components.clear();
+  unprocessed_features.clear();
+  slc_required.clear();
+  project_summary["choices"] = std::move(snapshot["choices"]);
+  template_contributions     = std::move(snapshot["template_contributions"]);
+
+  // Only rewrites contribution files that have been removed
+  save_template_contributions();
+
+  project_summary["data"] = nlohmann::json::object();
+  aggregates.clear();
+  return true;
+}
+
+/**
+ * @brief Saves the resolved project to yakka_resolution.cbor so the next run with the same command line can skip the resolution.
+ *        Must be called after @ref save_summary. Nothing is saved if the resolution was incomplete.
+ */
+void project::save_resolution_snapshot()
+{
+  std::error_code error;
+  if (resolution_key.is_null() || current_state != state::PROJECT_VALID || !unknown_components.empty() || !slc_required.empty() || !incomplete_choices.empty() || !multiple_answer_choices.empty()) {
+    fs::remove(project_resolution_file, error);
+    return;
+  }
+
+  nlohmann::json snapshot;
+  snapshot["version"]      = 2;
+  snapshot["key"]          = resolution_key;
+  snapshot["summary_hash"] = project_summary_snapshot_hash;
+  snapshot["files"]        = nlohmann::json::array();
+  snapshot["components"]   = nlohmann::json::array();
+  snapshot["directories"]  = nlohmann::json::array();
+  snapshot["inputs"]       = nlohmann::json::array();
+  for (const auto &[file, cached]: component_cache) {
+    if (!cached.used)
+      continue;
+    nlohmann::json entry;
+    entry["file"]           = file;
+    entry["id"]             = cached.id;
+    entry["package_path"]   = cached.package_path;
+    entry["component_path"] = cached.component_path;
+    entry["type"]           = cached.type;
+    entry["last_modified"]  = cached.last_modified;
+    entry["size"]           = cached.size;
+    entry["json"]           = nlohmann::json::binary(cached.json);
+    snapshot["files"].push_back(std::move(entry));
+  }
+
+  for (const auto &c: components) {
+    const auto cached = component_cache.find(c->file_path.generic_string());
+    if (cached == component_cache.end() || !cached->second.used) {
+      fs::remove(project_resolution_file, error);
+      return;
+    }
+    snapshot["components"].push_back(cached->first);
+
+    if (c->type != component::SLCE_FILE)
+      continue;
+    const auto &json = component_json(c);
+    if (!json.contains("component_path"))
+      continue;
+    for (const auto &p: json["component_path"]) {
+      const fs::path search_path = p["path"].get<std::string>();
+      if (auto stamp = file_stamp(search_path))
+        snapshot["directories"].push_back({ search_path.generic_string(), stamp->first });
+      for (auto i = fs::recursive_directory_iterator(search_path, error); !error && i != fs::recursive_directory_iterator(); i.increment(error))
+        if (i->is_directory())
+          if (auto stamp = file_stamp(i->path()))
+            snapshot["directories"].push_back({ i->path().generic_string(), stamp->first });
+    }
+  }
+
+  for (const auto &i: resolution_inputs) {
+    if (auto stamp = file_stamp(i))
+      snapshot["inputs"].push_back({ i, stamp->first, stamp->second });
+    else
+      snapshot["inputs"].push_back(nlohmann::json::array({ i }));
+  }
+
+  std::vector<std::string> sorted_components(required_components.begin(), required_components.end());
+  std::sort(sorted_components.begin(), sorted_components.end());
+  snapshot["required_components"] = sorted_components;
+  std::vector<std::string> sorted_features(required_features.begin(), required_features.end());
+  std::sort(sorted_features.begin(), sorted_features.end());
+  snapshot["required_features"] = sorted_features;
+  snapshot["instances"]         = nlohmann::json::array();
+  for (const auto &[name, instance]: instances)
+    snapshot["instances"].push_back({ name, instance });
+  snapshot["choices"]                = project_summary["choices"];
+  snapshot["template_contributions"] = template_contributions;
+
+  std::string data;
+  nlohmann::json::to_cbor(snapshot, data);
+  std::ofstream snapshot_file(project_resolution_file, std::ios::binary);
+  snapshot_file.write(data.data(), data.size());
 }
 
 class custom_error_handler : public nlohmann::json_schema::basic_error_handler {
@@ -1344,14 +2298,15 @@ public:
   }
 };
 
-void project::validate_schema()
+bool project::validate_schema()
 {
   // Collect all the schema data
   nlohmann::json schema = "{ \"properties\": {} }"_json;
 
   for (const auto &c: components) {
-    if (c->json.contains("schema")) {
-      json_node_merge(schema["properties"], c->json["schema"]);
+    const auto &json = component_json(c);
+    if (json.contains("schema")) {
+      json_node_merge(schema["properties"], json["schema"]);
     }
   }
 
@@ -1363,16 +2318,18 @@ void project::validate_schema()
       validator.set_root_schema(schema);
     } catch (const std::exception &e) {
       spdlog::error("Setting root schema failed\n{}", e.what());
-      return;
+      return false;
     }
 
     // Iterate through each component and validate
     custom_error_handler err;
     for (const auto &c: components) {
       err.component_name = c->id;
-      validator.validate(c->json, err);
+      validator.validate(component_json(c), err);
     }
+    return !err;
   }
+  return true;
 }
 
 bool project::is_disqualified_by_unless(const nlohmann::json &node)
@@ -1395,7 +2352,11 @@ bool project::condition_is_fulfilled(const nlohmann::json &node)
   return true;
 }
 
-void project::create_config_file(const std::shared_ptr<yakka::component> component, const nlohmann::json &config, const std::string &prefix, std::string instance_name)
+/**
+ * @brief Adds the blueprint that instantiates a config file, using the file of an overriding component if there is one
+ * @return The config file that was looked for
+ */
+std::string project::create_config_file(const std::shared_ptr<yakka::component> component, const nlohmann::json &config, const std::string &prefix, std::string instance_name, inja::Environment &inja_env, nlohmann::json &output)
 {
   std::string config_filename = config["path"].get<std::string>();
   fs::path config_file_path   = component->component_path / config_filename;
@@ -1407,7 +2368,7 @@ void project::create_config_file(const std::shared_ptr<yakka::component> compone
       auto overriding_components = slc_overrides.equal_range(file_id);
       for (auto c = overriding_components.first; c != overriding_components.second; ++c) {
         // Find the matching config, check conditions, and matching instance.
-        for (const auto &i: c->second->json["config_file"]) {
+        for (const auto &i: c->second->json.at("config_file")) {
           if (i.contains("override") && i["override"]["file_id"].get<std::string>() == file_id && !is_disqualified_by_unless(i) && condition_is_fulfilled(i)) {
             if (i["override"].contains("instance") && i["override"]["instance"].get<std::string>() == instance_name) {
               config_file_path = c->second->component_path / i["path"].get<std::string>();
@@ -1422,8 +2383,8 @@ void project::create_config_file(const std::shared_ptr<yakka::component> compone
     }
   }
 
-  config_file_path          = this->inja_environment.render(config_file_path.generic_string(), { { "instance", prefix } });
-  fs::path destination_path = fs::path{ default_output_directory + project_name + "/config" } / this->inja_environment.render(fs::path(config_filename).filename().string(), { { "instance", instance_name } });
+  config_file_path          = inja_env.render(config_file_path.generic_string(), { { "instance", prefix } });
+  fs::path destination_path = fs::path{ default_output_directory + project_name + "/config" } / inja_env.render(fs::path(config_filename).filename().string(), { { "instance", instance_name } });
   if (!instance_name.empty()) {
     // Convert instance name uppercase
     std::transform(instance_name.begin(), instance_name.end(), instance_name.begin(), ::toupper);
@@ -1431,60 +2392,100 @@ void project::create_config_file(const std::shared_ptr<yakka::component> compone
 
   if (!fs::exists(config_file_path)) {
     spdlog::error("Failed to find config_file: {}", config_file_path.string());
-    return;
+    return config_file_path.generic_string();
   }
 
   // Create blueprints
   nlohmann::json blueprint = { { "depends", nullptr }, { "process", nullptr } };
   blueprint["depends"].push_back(config_file_path.string());
-  blueprint["depends"].push_back("{{project_output}}/template_contributions.json");
-  blueprint["process"].push_back({ { "inja", "{% set input = read_file(\"" + config_file_path.string() + "\" )%}{{replace(input, \"\\bINSTANCE\\b\", \"" + instance_name + "\")}}" } });
-  blueprint["process"].push_back({ { "save", nullptr } });
+  blueprint["process"].push_back({ { "instantiate", { { "source", config_file_path.string() }, { "instance", instance_name } } } });
+
+  output["blueprints"][destination_path.string()] = blueprint;
+  output["generated"]["includes"].push_back(destination_path.string());
+  return config_file_path.generic_string();
+}
 
-  component->json["blueprints"][destination_path.string()] = blueprint;
-  component->json["generated"]["includes"].push_back(destination_path.string());
+/**
+ * @brief Returns the pool used to process the SLC rules of the components.
+ *        It is created on first use and shared by every evaluation, including the re-evaluations of the build server.
+ */
+static tf::Executor &slc_rules_executor()
+{
+  static tf::Executor executor(std::min(32U, std::max(1U, std::thread::hardware_concurrency())));
+  return executor;
 }
 
 void project::process_slc_rules()
 {
-  // Go through each SLC based component
-  // std::vector<std::shared_ptr<yakka::component>>::size_type size = components.size();
+  struct template_blueprint {
+    std::shared_ptr<yakka::component> component;
+    std::string target;
+    std::string template_path;
+  };
+
+  // A template contribution ordered by priority. Sequence is the order the contribution was found and breaks ties.
+  struct template_contribution {
+    int priority;
+    size_t sequence;
+    nlohmann::json value;
+  };
+
+  // Results of processing a single component. Components are processed in parallel and the results are merged in component order.
+  struct component_output {
+    nlohmann::json additions = nlohmann::json::object();
+    std::vector<std::pair<std::string, template_contribution>> contributions;
+    std::vector<template_blueprint> template_blueprints;
+    std::vector<std::string> inputs;
+  };
+
+  // Process SLCE files and add every component found in the component paths. This can add components so it is done first.
   for (std::vector<std::shared_ptr<yakka::component>>::size_type i = 0; i < components.size(); ++i) {
-    const auto &c = components[i];
-    if (c->type == component::YAKKA_FILE)
+    const auto c = components[i];
+    if (c->type != component::SLCE_FILE)
       continue;
 
-    auto instance_names               = instances.equal_range(c->id);
-    const bool instantiable           = c->json.contains("instantiable");
-    const std::string instance_prefix = (instantiable) ? c->json["instantiable"]["prefix"].get<std::string>() : "";
-
-    // Process SLCE files and add every component found in the component paths
-    if (c->type == component::SLCE_FILE) {
-      std::unordered_set<std::filesystem::path> added_components;
-      // Find all .slcc files in the component paths and add them
-      for (const auto &p: c->json["component_path"]) {
-        for (const auto &component_path: glob::rglob(p["path"].get<std::string>() + "/**/*.slcc")) {
-          // Only add component if it hasn't been seen before
-          if (added_components.insert(component_path).second == true) {
-            std::shared_ptr<yakka::component> new_component = std::make_shared<yakka::component>();
-            if (new_component->parse_file(component_path, "") == yakka::yakka_status::SUCCESS) {
-              components.push_back(new_component);
-              // ++size;
-              // Process all the required components
-              if (new_component->json.contains("requires") && new_component->json["requires"].contains("features"))
-                for (const auto &r: new_component->json["requires"]["features"])
-                  slc_required.insert(r.get<std::string>());
-            }
+    std::unordered_set<std::filesystem::path> added_components;
+    // Find all .slcc files in the component paths and add them
+    for (const auto &p: c->json["component_path"]) {
+      for (const auto &component_path: glob::rglob(p["path"].get<std::string>() + "/**/*.slcc")) {
+        // Only add component if it hasn't been seen before
+        if (added_components.insert(component_path).second == true) {
+          std::shared_ptr<yakka::component> new_component = std::make_shared<yakka::component>();
+          if (parse_component(new_component, component_path, "") == yakka::yakka_status::SUCCESS) {
+            components.push_back(new_component);
+            index_supports(new_component, new_component->json);
+            // Process all the required components
+            if (new_component->json.contains("requires") && new_component->json["requires"].contains("features"))
+              for (const auto &r: new_component->json["requires"]["features"])
+                slc_required.insert(r.get<std::string>());
           }
         }
       }
-      evaluate_dependencies();
-      continue;
     }
+    evaluate_dependencies();
+  }
+
+  // Evaluate the rules of each SLC component. Component JSON is only read here, all results go to the component's output.
+  // Templates are rendered by the jinja tool unless the workspace configuration opts in to the 'jinja' built-in with 'in_process_jinja'.
+  const bool in_process_jinja = workspace.configuration_json.is_object() && workspace.configuration_json.value("in_process_jinja", false);
+  resolution_inputs.clear();
+  std::vector<component_output> outputs(components.size());
+  auto process_component = [&](size_t index) {
+    const auto &c = components[index];
+    if (c->type == component::YAKKA_FILE || c->type == component::SLCE_FILE)
+      return;
+
+    auto &output                      = outputs[index];
+    auto &additions                   = output.additions;
+    const auto &json                  = c->json;
+    auto instance_names               = instances.equal_range(c->id);
+    const bool instantiable           = json.contains("instantiable");
+    const std::string instance_prefix = (instantiable) ? json["instantiable"]["prefix"].get<std::string>() : "";
+    inja::Environment inja_env;
 
     // Process sources
-    if (c->json.contains("source")) {
-      for (const auto &p: c->json["source"]) {
+    if (json.contains("source")) {
+      for (const auto &p: json["source"]) {
         if (!p.contains("path"))
           continue;
         if (is_disqualified_by_unless(p) || !condition_is_fulfilled(p))
@@ -1492,84 +2493,79 @@ void project::process_slc_rules()
 
         fs::path source_path{ p["path"].get<std::string>() };
         if (source_path.extension() != ".h")
-          c->json["sources"].push_back(p["path"]);
+          additions["sources"].push_back(p["path"]);
       }
     }
 
     // Process 'include'
-    if (c->json.contains("include")) {
-      for (const auto &p: c->json["include"]) {
+    if (json.contains("include")) {
+      for (const auto &p: json["include"]) {
         if (is_disqualified_by_unless(p) || !condition_is_fulfilled(p))
           continue;
 
-        c->json["includes"]["global"].push_back(p["path"]);
+        additions["includes"]["global"].push_back(p["path"]);
       }
     }
 
     // Process 'define'
-    if (c->json.contains("define")) {
-      for (const auto &p: c->json["define"]) {
+    if (json.contains("define")) {
+      for (const auto &p: json["define"]) {
         if (is_disqualified_by_unless(p) || !condition_is_fulfilled(p))
           continue;
 
         nlohmann::json temp = p.contains("value") ? p : p["name"];
         if (instantiable) {
           if (temp.contains("value"))
-            temp["name"] = this->inja_environment.render(temp["name"].get<std::string>(), { { "instance", instance_prefix } });
+            temp["name"] = inja_env.render(temp["name"].get<std::string>(), { { "instance", instance_prefix } });
           else
-            temp = this->inja_environment.render(temp.get<std::string>(), { { "instance", instance_prefix } });
+            temp = inja_env.render(temp.get<std::string>(), { { "instance", instance_prefix } });
         }
-        c->json["defines"]["global"].push_back(temp);
+        additions["defines"]["global"].push_back(temp);
       }
     }
 
     // Process library
-    if (c->json.contains("library")) {
-      for (const auto &p: c->json["library"]) {
+    if (json.contains("library")) {
+      for (const auto &p: json["library"]) {
         if (!p.contains("path"))
           continue;
         if (is_disqualified_by_unless(p) || !condition_is_fulfilled(p))
           continue;
 
-        fs::path source_path{ p["path"].get<std::string>() };
-        c->json["libraries"].push_back(p["path"]);
+        additions["libraries"].push_back(p["path"]);
       }
     }
 
     // Process template_contributions
-    if (c->json.contains("template_contribution")) {
-      for (const auto &t: c->json["template_contribution"]) {
+    if (json.contains("template_contribution")) {
+      auto &contributions = output.contributions;
+      for (const auto &t: json["template_contribution"]) {
         if (is_disqualified_by_unless(t) || !condition_is_fulfilled(t))
           continue;
 
-        const auto name = t["name"].get<std::string>();
-        if (instantiable && t.contains("value")) {
-          if (t["value"].is_string()) {
-            const auto value = t["value"].get<std::string>();
-            for (auto i = instance_names.first; i != instance_names.second; ++i) {
-              template_contributions[name].push_back(t);
-              template_contributions[name].back()["value"] = this->inja_environment.render(value, { { "instance", i->second } });
-            }
-          } else if (t["value"].is_object()) {
-            for (auto i = instance_names.first; i != instance_names.second; ++i) {
-              template_contributions[name].push_back(t);
-              for (auto &[key, value]: template_contributions[name].back()["value"].items()) {
-                if (value.is_string())
-                  template_contributions[name].back()["value"][key] = this->inja_environment.render(value.get<std::string>(), { { "instance", i->second } });
-              }
-            }
-          } else {
-            template_contributions[name].push_back(t);
+        const auto name     = t["name"].get<std::string>();
+        const auto priority = t.contains("priority") ? t["priority"].get<int>() : 0;
+        const auto value    = t.contains("value") ? t["value"] : nlohmann::json{};
+        if (instantiable && value.is_string()) {
+          for (auto i = instance_names.first; i != instance_names.second; ++i)
+            contributions.push_back({ name, { priority, 0, inja_env.render(value.get<std::string>(), { { "instance", i->second } }) } });
+        } else if (instantiable && value.is_object()) {
+          for (auto i = instance_names.first; i != instance_names.second; ++i) {
+            auto instance_value = value;
+            for (auto &[key, item]: instance_value.items())
+              if (item.is_string())
+                item = inja_env.render(item.get<std::string>(), { { "instance", i->second } });
+            contributions.push_back({ name, { priority, 0, std::move(instance_value) } });
           }
         } else {
-          template_contributions[name].push_back(t);
+          contributions.push_back({ name, { priority, 0, value } });
         }
       }
     }
 
     // Process config_file
-    if (c->json.contains("config_file")) {
-      for (const auto &config: c->json["config_file"]) {
+    if (json.contains("config_file")) {
+      for (const auto &config: json["config_file"]) {
         if (!config.contains("path"))
           continue;
         if (is_disqualified_by_unless(config) || !condition_is_fulfilled(config))
@@ -1582,123 +2578,246 @@ void project::process_slc_rules()
         // Check if this component is instantiable and there are instances
         if (instantiable)
           for (auto i = instance_names.first; i != instance_names.second; ++i)
-            create_config_file(c, config, instance_prefix, i->second);
+            output.inputs.push_back(create_config_file(c, config, instance_prefix, i->second, inja_env, additions));
         else
-          create_config_file(c, config, instance_prefix, instance_prefix);
+          output.inputs.push_back(create_config_file(c, config, instance_prefix, instance_prefix, inja_env, additions));
       }
+    }
 
-      // Process 'template_file'
-      if (c->json.contains("template_file")) {
-        for (const auto &t: c->json["template_file"]) {
-          if (is_disqualified_by_unless(t) || !condition_is_fulfilled(t))
-            continue;
+    // Process 'template_file'
+    if (json.contains("template_file")) {
+      for (const auto &t: json["template_file"]) {
+        if (is_disqualified_by_unless(t) || !condition_is_fulfilled(t))
+          continue;
 
-          fs::path template_file = t["path"].get<std::string>();
-          fs::path target_file   = template_file.filename();
-          target_file.replace_extension();
-
-          const auto target = "{{project_output}}/generated/" + target_file.string();
-
-          auto add_generated_item = [&](nlohmann::json &node) {
-            // Create generated items
-            if (target_file.extension() == ".c" || target_file.extension() == ".cpp")
-              node["generated"]["sources"].push_back(target);
-            else if (target_file.extension() == ".h" || target_file.extension() == ".hpp")
-              node["generated"]["includes"].push_back(target);
-            else if (target_file.extension() == ".ld")
-              node["generated"]["linker_script"].push_back(target);
-            else
-              node["generated"]["files"].push_back(target);
-          };
-
-          add_generated_item(c->json);
-
-          // Create blueprints
-          nlohmann::json blueprint = { { "depends", nullptr }, { "process", nullptr } };
-          blueprint["depends"].push_back({ { c->json["directory"].get<std::string>() + "/" + template_file.string() } });
-          blueprint["depends"].push_back({ { "{{project_output}}/template_contributions.json" } });
-          blueprint["process"].push_back({ { "jinja", "-t " + c->json["directory"].get<std::string>() + "/" + template_file.string() + " -d {{project_output}}/template_contributions.json" } });
-          blueprint["process"].push_back({ { "save", nullptr } });
-
-          c->json["blueprints"][target] = blueprint;
-        }
+        fs::path template_file = t["path"].get<std::string>();
+        fs::path target_file   = template_file.filename();
+        target_file.replace_extension();
+
+        const auto target = "{{project_output}}/generated/" + target_file.string();
+
+        // Create generated items
+        if (target_file.extension() == ".c" || target_file.extension() == ".cpp")
+          additions["generated"]["sources"].push_back(target);
+        else if (target_file.extension() == ".h" || target_file.extension() == ".hpp")
+          additions["generated"]["includes"].push_back(target);
+        else if (target_file.extension() == ".ld")
+          additions["generated"]["linker_script"].push_back(target);
+        else
+          additions["generated"]["files"].push_back(target);
+
+        // Create blueprints. Dependencies on the template contributions are added once all contributions are known.
+        const auto template_path = json["directory"].get<std::string>() + "/" + template_file.string();
+        nlohmann::json blueprint = { { "depends", nullptr }, { "process", nullptr } };
+        blueprint["depends"].push_back(template_path);
+        if (in_process_jinja)
+          blueprint["process"].push_back({ { "jinja", { { "template_file", template_path }, { "data_file", "{{project_output}}/template_contributions.json" } } } });
+        else
+          blueprint["process"].push_back({ { "jinja", "-t " + template_path + " -d {{project_output}}/template_contributions.json" } });
+        blueprint["process"].push_back({ { "save", nullptr } });
+
+        additions["blueprints"][target] = blueprint;
+        output.template_blueprints.push_back({ c, target, template_path });
       }
+    }
 
-      // Process special toolchain settings
-      if (c->json.contains("toolchain_settings")) {
-        for (const auto &s: c->json["toolchain_settings"]) {
-          if (s["option"] == "linkerfile") {
-            if (is_disqualified_by_unless(s) || !condition_is_fulfilled(s))
-              continue;
+    // Process special toolchain settings
+    if (json.contains("toolchain_settings")) {
+      for (const auto &s: json["toolchain_settings"]) {
+        if (s["option"] == "linkerfile") {
+          if (is_disqualified_by_unless(s) || !condition_is_fulfilled(s))
+            continue;
 
-            c->json["generated"]["linker_script"] = "{{project_output}}/generated/" + fs::path{ s["value"].get<std::string>() }.filename().string();
-          }
+          additions["generated"]["linker_script"] = "{{project_output}}/generated/" + fs::path{ s["value"].get<std::string>() }.filename().string();
         }
       }
     }
+  };
 
-    // Process toolchain settings
-    project_summary["toolchain_settings"] = nlohmann::json::object();
-    for (const auto &c: components) {
-      if (c->json.contains("toolchain_settings") == false)
-        continue;
+  {
+    tf::Taskflow slc_taskflow;
+    slc_taskflow.for_each_index(size_t{ 0 }, components.size(), size_t{ 1 }, process_component);
+    slc_rules_executor().run(slc_taskflow).wait();
+  }
 
-      for (const auto &s: c->json["toolchain_settings"]) {
-        if (is_disqualified_by_unless(s) || !condition_is_fulfilled(s))
-          continue;
+  // Merge the results in component order. Arrays are appended to and other values replace the existing value.
+  std::function<void(nlohmann::json &, const nlohmann::json &)> merge = [&](nlohmann::json &target, const nlohmann::json &node) {
+    if (node.is_object()) {
+      if (!target.is_object())
+        target = nlohmann::json::object();
+      for (const auto &[key, value]: node.items())
+        merge(target[key], value);
+    } else if (node.is_array()) {
+      for (const auto &i: node)
+        target.push_back(i);
+    } else
+      target = node;
+  };
 
-        const auto key = s["option"].get<std::string>();
-        if (project_summary["toolchain_settings"].contains(key))
-          if (project_summary["toolchain_settings"][key].is_array())
-            project_summary["toolchain_settings"][key].push_back(s["value"]);
-          else
-            project_summary["toolchain_settings"][key] = nlohmann::json::array({ project_summary["toolchain_settings"][key], s["value"] });
+  std::vector<template_blueprint> template_blueprints;
+  std::map<std::string, std::vector<template_contribution>> contributions;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    auto &output = outputs[i];
+    if (!output.additions.empty())
+      merge(components[i]->json, output.additions);
+    for (auto &[name, contribution]: output.contributions) {
+      auto &list            = contributions[name];
+      contribution.sequence = list.size();
+      list.push_back(std::move(contribution));
+    }
+    template_blueprints.insert(template_blueprints.end(), output.template_blueprints.begin(), output.template_blueprints.end());
+    resolution_inputs.insert(output.inputs.begin(), output.inputs.end());
+  }
+
+  // Process toolchain settings
+  project_summary["toolchain_settings"] = nlohmann::json::object();
+  for (const auto &c: components) {
+    if (c->json.contains("toolchain_settings") == false)
+      continue;
+
+    for (const auto &s: c->json["toolchain_settings"]) {
+      if (is_disqualified_by_unless(s) || !condition_is_fulfilled(s))
+        continue;
+
+      const auto key = s["option"].get<std::string>();
+      if (project_summary["toolchain_settings"].contains(key))
+        if (project_summary["toolchain_settings"][key].is_array())
+          project_summary["toolchain_settings"][key].push_back(s["value"]);
         else
-          project_summary["toolchain_settings"][key] = s["value"];
-      }
+          project_summary["toolchain_settings"][key] = nlohmann::json::array({ project_summary["toolchain_settings"][key], s["value"] });
+      else
+        project_summary["toolchain_settings"][key] = s["value"];
     }
   }
 
-  // Go through the template_contributions and sort via priorities
-  nlohmann::json new_contributions;
-  for (auto &item: template_contributions) {
-    while (!item.is_null() && item.size() > 0) {
-      // Remove the item with the lowest priority
-      int lowest_priority       = INT_MAX;
-      int lowest_priority_index = 0;
-      for (size_t i = 0; i < item.size(); ++i) {
-        int priority = item[i].contains("priority") ? item[i]["priority"].get<int>() : 0;
-        if (priority < lowest_priority) {
-          lowest_priority       = priority;
-          lowest_priority_index = i;
-        }
-      }
-      nlohmann::json entry = item[lowest_priority_index];
-      spdlog::info("Ordering '{}' at priority {}", entry["name"].get<std::string>(), lowest_priority);
+  // Sort the template contributions by priority. Contributions with the same priority keep the order they were found in.
+  template_contributions = nlohmann::json();
+  for (auto &[name, list]: contributions) {
+    std::sort(list.begin(), list.end(), [](const template_contribution &a, const template_contribution &b) {
+      return a.priority != b.priority ? a.priority < b.priority : a.sequence < b.sequence;
+    });
+    auto &values = template_contributions[name];
+    for (auto &c: list) {
+      spdlog::debug("Ordering '{}' at priority {}", name, c.priority);
+      values.push_back(std::move(c.value));
+    }
+  }
 
-      //const std::string value = entry["value"].get<std::string>();
-      new_contributions[entry["name"].get<std::string>()].push_back(entry["value"]);
-      item.erase(lowest_priority_index);
+  // Each template only depends on the contributions it references. Names from the previous run are included so removing a contribution also rebuilds.
+  std::unordered_set<std::string> contribution_names;
+  for (const auto &[name, value]: template_contributions.items())
+    contribution_names.insert(name);
+  if (project_summary.contains("template_contribution_hashes"))
+    for (const auto &[name, value]: project_summary["template_contribution_hashes"].items())
+      contribution_names.insert(name);
+
+  for (const auto &t: template_blueprints) {
+    std::set<fs::path> scanned;
+    auto &depends   = t.component->json["blueprints"][t.target]["depends"];
+    auto referenced = template_contribution_references(t.template_path, contribution_names, scanned);
+    for (const auto &s: scanned)
+      resolution_inputs.insert(s.generic_string());
+    if (!referenced.has_value()) {
+      depends.push_back("{{project_output}}/template_contributions.json");
+      continue;
     }
+    for (const auto &name: referenced.value())
+      depends.push_back("{{project_output}}/template_contributions/" + name + ".json");
   }
-  template_contributions = new_contributions;
+}
+
+/**
+ * @brief Returns the data of a component. Once the project summary is generated the data of the project components is held by the summary.
+ */
+const nlohmann::json &project::component_json(const std::shared_ptr<component> &c) const
+{
+  if (c->json.is_null()) {
+    const auto summary_components = project_summary.find("components");
+    if (summary_components != project_summary.end()) {
+      const auto entry = summary_components->find(c->id);
+      if (entry != summary_components->end())
+        return *entry;
+    }
+  }
+  return c->json;
 }
 
 void project::process_blueprints(const std::shared_ptr<component> c)
 {
-  if (c->json.contains("blueprints")) {
-    for (const auto &[b_key, b_value]: c->json["blueprints"].items()) {
-      std::string blueprint_string = try_render(inja_environment, b_value.contains("regex") ? b_value["regex"].get<std::string>() : b_key, project_summary);
-      spdlog::info("Additional blueprint: {}", blueprint_string);
-      blueprint_database.blueprints.insert({ blueprint_string, std::make_shared<blueprint>(blueprint_string, b_value, c->json["directory"].get<std::string>()) });
+  const auto &json = component_json(c);
+  if (json.contains("blueprints")) {
+    for (const auto &[b_key, b_value]: json["blueprints"].items()) {
+      const std::string name = b_value.contains("regex") ? b_value["regex"].get<std::string>() : b_key;
+      auto new_blueprint     = std::make_shared<blueprint>(name, b_value, json["directory"].get<std::string>());
+
+      // Templated names are rendered when a target could match them
+      if (has_template_markup(name))
+        blueprint_database.add_template(name, std::move(new_blueprint), project_summary);
+      else
+        blueprint_database.add(name, std::move(new_blueprint));
+    }
+  }
+}
+
+void project::render_blueprint_templates(std::string_view target)
+{
+  blueprint_database.render_templates(target, [this](const std::string &name) {
+    return try_render(inja_environment, name, project_summary);
+  });
+}
+
+/**
+ * @brief Resolves the process steps of the blueprints matched by the target database to a tool or a built-in command.
+ *        Blueprints no target reaches are not compiled. Every problem with a reached blueprint is logged here, before anything is built.
+ *        Must be called once the tools and built-in commands are loaded and the target database is generated.
+ * @return false if a reached blueprint has a malformed step or an unknown command
+ */
+bool project::compile_blueprints()
+{
+  std::unordered_set<const blueprint *> reported;
+  bool valid = true;
+  for (const auto &[target, match]: target_database.targets) {
+    if (!match)
+      continue;
+    auto &b = *match->blueprint;
+    if (!b.compiled)
+      compile_blueprint(b);
+    if (b.errors.empty() || !reported.insert(&b).second)
+      continue;
+
+    for (const auto &e: b.errors)
+      spdlog::error("{} in blueprint '{}'", e, b.target);
+    valid = false;
+  }
+  return valid;
+}
+
+void project::compile_blueprint(blueprint &b)
+{
+  b.compiled = true;
+  for (auto &step: b.steps) {
+    // Built-in commands take structured arguments, so a step that doesn't pass a string isn't given to a tool of the same name
+    if (project_summary["tools"].contains(step.name) && (step.argument.is_string() || !blueprint_commands.contains(step.name))) {
+      if (!step.argument.is_string()) {
+        b.errors.push_back("Arguments of tool '" + step.name + "' must be a string");
+        continue;
+      }
+      step.type = blueprint::process_step::TOOL_STEP;
+      step.tool = project_summary["tools"][step.name].get<std::string>();
+    } else if (auto command = blueprint_commands.find(step.name); command != blueprint_commands.end()) {
+      step.type    = blueprint::process_step::BUILTIN_STEP;
+      step.command = &command->second;
+    } else {
+      b.errors.push_back(step.name + " tool doesn't exist");
     }
   }
 }
 
 void project::process_tools(const std::shared_ptr<component> c)
 {
-  if (c->json.contains("tools")) {
-    for (auto &[key, value]: c->json["tools"].items()) {
+  const auto &json = component_json(c);
+  if (json.contains("tools")) {
+    for (const auto &[key, value]: json["tools"].items()) {
       inja::Environment inja_env = inja::Environment();
       inja_env.add_callback("curdir", 0, [&c](const inja::Arguments &args) {
         return std::filesystem::absolute(c->component_path).string();
@@ -1709,6 +2828,45 @@ void project::process_tools(const std::shared_ptr<component> c)
   }
 }
 
+/**
+ * @brief Ensures all the commands have a blueprint by adding the component that provides a missing one
+ * @return false if more than one component provides a missing blueprint
+ */
+bool project::add_missing_blueprints()
+{
+  spdlog::info("Checking for missing blueprints");
+  for (const auto &c: commands) {
+    render_blueprint_templates(c);
+    if (blueprint_database.blueprints.contains(c))
+      continue;
+
+    // Find a component that has that blueprint
+    auto result = workspace.find_blueprint(c);
+    if (result) {
+      const auto blueprint_options = result.value();
+      if (blueprint_options.size() == 1) {
+        const auto &component_name = blueprint_options[0].get<std::string>();
+        auto component_paths       = workspace.find_component(component_name);
+        if (component_paths) {
+          auto [component_path, db_path] = component_paths.value();
+          spdlog::info("Found a blueprint for {}: {}", c, component_path.string());
+          add_additional_tool(component_path);
+        } else {
+          spdlog::error("Could not find component for blueprint: {}", c);
+        }
+      } else {
+        spdlog::error("Multiple options for missing blueprint {}", c);
+        for (const auto &o: blueprint_options)
+          spdlog::error("- {}", o.get<std::string>());
+        return false;
+      }
+    } else {
+      spdlog::info("Did not find a blueprint for {}", c);
+    }
+  }
+  return true;
+}
+
 void project::add_additional_tool(const fs::path component_path)
 {
   // Load component
@@ -5,6 +5,7 @@
 #include "yakka_workspace.hpp"
 #include "component_database.hpp"
 #include "blueprint_database.hpp"
+#include "slc_project.hpp"
 //#include "yaml-cpp/yaml.h"
 #include "nlohmann/json.hpp"
 #include "inja.hpp"
@@ -14,6 +15,7 @@
 #include <filesystem>
 #include <regex>
 #include <map>
+#include <set>
 #include <unordered_set>
 #include <optional>
 #include <functional>
@@ -23,8 +25,6 @@ namespace fs = std::filesystem;
 namespace yakka {
 const std::string default_output_directory = "output/";
 
-typedef std::function<yakka::process_return(std::string, const nlohmann::json &, std::string, const nlohmann::json &, inja::Environment &)> blueprint_command;
-
 struct task_group {
   std::string name;
   int total_count;
@@ -67,6 +67,35 @@ public:
     PROJECT_VALID
   };
 
+  // Requirement provenance. Allows a replaced component to be retracted without restarting the evaluation
+  struct requirement_source {
+    std::vector<std::string> components;
+    std::vector<std::string> features;
+    std::vector<std::string> choices;
+    std::vector<std::string> slc_required;
+    std::vector<std::string> slc_provided;
+    std::vector<std::pair<std::string, std::string>> instances;
+  };
+  struct support_application {
+    std::string component_id; // Component whose json received the merged node
+    std::string kind;         // "components" or "features"
+    std::string name;         // Name of the component or feature that triggered the support
+    std::string parent;       // Source that applied this support
+    std::string source;       // Source key for everything introduced by the merged node
+    nlohmann::json node;
+  };
+  // A parsed component file in the resolution snapshot
+  struct cached_component {
+    std::string id;
+    std::string package_path;
+    std::string component_path;
+    int type;
+    int64_t last_modified;
+    uintmax_t size;
+    nlohmann::json::binary_t json;
+    bool used; // Parsed for the current resolution
+  };
+
 public:
   project(const std::string project_name, yakka::workspace &workspace);
 
@@ -77,21 +106,43 @@ public:
   void init_project(const std::string build_string);
   void process_build_string(const std::string build_string);
   void parse_project_string(const std::vector<std::string> &project_string);
-  void process_requirements(std::shared_ptr<yakka::component> component, nlohmann::json child_node);
+  void process_requirements(std::shared_ptr<yakka::component> component, nlohmann::json child_node, const std::string &source);
+  void apply_support(std::shared_ptr<yakka::component> component, const std::string &kind, const std::string &name, const nlohmann::json &node, const std::string &parent);
   state evaluate_dependencies();
   bool add_component(const std::string &component_name, component_database::flag flags);
   bool add_feature(const std::string &feature_name);
+  void require_component(const std::string &component_name, const std::string &source);
+  void require_feature(const std::string &feature_name, const std::string &source);
+  void require_slc_feature(const std::string &feature_name, const std::string &source);
+  void provide_slc_feature(const std::string &feature_name, const std::string &source);
+  void add_instance(const std::string &component_name, const std::string &instance_name, const std::string &source);
+  void retract_component(const std::string &component_id);
+  void retract_feature(const std::string &feature_name);
+  void retract_source(const std::string &source);
+  void retract_support_applications(std::function<bool(const support_application &)> predicate);
+  void index_supports(std::shared_ptr<yakka::component> component, const nlohmann::json &node);
+  void unindex_supports(std::shared_ptr<yakka::component> component);
   //std::optional<fs::path> find_component(const std::string component_dotname);
   void evaluate_choices();
   void add_additional_tool(const fs::path component_path);
 
   // Component processing functions
+  const nlohmann::json &component_json(const std::shared_ptr<component> &c) const;
   void process_tools(const std::shared_ptr<component> c);
   void process_blueprints(const std::shared_ptr<component> c);
+  void render_blueprint_templates(std::string_view target);
+  bool compile_blueprints();
+  void compile_blueprint(blueprint &b);
 
   void process_blueprints();
+  bool add_missing_blueprints();
   void update_summary();
   void generate_project_summary();
+  void load_summary_snapshot();
+  void load_previous_summary_component(const std::string &name);
+  bool load_resolution_snapshot();
+  void save_resolution_snapshot();
+  yakka_status parse_component(std::shared_ptr<yakka::component> component, const fs::path &file_path, const fs::path &package_path);
 
   // Target database management
   //void add_to_target_database( const std::string target );
@@ -101,10 +152,14 @@ public:
   void set_project_file(const std::string filepath);
   void process_construction(indicators::ProgressBar &bar);
   void save_summary();
+  void save_template_contributions();
   void save_blueprints();
   void create_tasks(const std::string target_name, tf::Task &parent);
+  void create_tasks(interned_string target_name, tf::Task &parent);
+  void reset_tasks();
+  void clear_tasks();
 
-  void validate_schema();
+  bool validate_schema();
 
   // void add_required_component(std::shared_ptr<yakka::component> component);
   // void add_required_feature(const std::string feature, std::shared_ptr<yakka::component> component);
@@ -121,7 +176,6 @@ public:
   std::unordered_set<std::string> unprocessed_components;
   std::unordered_set<std::string> unprocessed_features;
   std::unordered_set<std::string> unprocessed_choices;
-  std::unordered_map<std::string, std::string> unprocessed_replacements;
   //std::unordered_set<std::string> replaced_components;
   std::unordered_map<std::string, std::string> replacements;
   std::unordered_set<std::string> required_components;
@@ -134,10 +188,36 @@ public:
   component_database::flag component_flags;
   bool project_has_slcc;
 
+  std::unordered_map<std::string, requirement_source> requirement_sources;
+  std::unordered_map<std::string, std::unordered_set<std::string>> component_requirers;
+  std::unordered_map<std::string, std::unordered_set<std::string>> feature_requirers;
+  std::unordered_set<std::string> retracted_components;
+  std::unordered_set<std::string> retracted_features;
+  std::vector<support_application> support_applications;
+  std::unordered_map<std::string, nlohmann::json> original_component_json;
+
+  // Reverse indexes from a component or feature name to the components that have a 'supports' entry for it
+  std::unordered_map<std::string, std::vector<std::shared_ptr<yakka::component>>> component_supporters;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<yakka::component>>> feature_supporters;
+  size_t evaluation_iterations;
+  size_t retraction_count;
+
   YAML::Node project_summary_yaml;
   std::string project_directory;
   std::string project_summary_file;
+  std::string project_summary_snapshot_file;
+  size_t project_summary_snapshot_hash;
   fs::file_time_type project_summary_last_modified;
+
+  // Components from the summary snapshot are kept as CBOR and only decoded when needed
+  std::unordered_map<std::string, nlohmann::json::binary_t> summary_snapshot_components;
+  std::unordered_set<std::string> summary_snapshot_stubs;
+
+  // Resolution snapshot. Parsed component files are cached by path and reused while their timestamp and size are unchanged.
+  std::string project_resolution_file;
+  nlohmann::json resolution_key;
+  std::set<std::string> resolution_inputs; // Template and config files read by process_slc_rules()
+  std::unordered_map<std::string, cached_component> component_cache;
   std::vector<std::shared_ptr<yakka::component>> components;
   //yakka::component_database component_database;
   yakka::blueprint_database blueprint_database;
@@ -145,13 +225,14 @@ public:
 
   nlohmann::json previous_summary;
   nlohmann::json project_summary;
+  aggregate_cache aggregates;
 
   yakka::workspace &workspace;
 
   // Blueprint evaluation
   inja::Environment inja_environment;
   //std::multimap<std::string, std::shared_ptr<blueprint_match> > target_database;
-  std::multimap<std::string, construction_task> todo_list;
+  std::unordered_multimap<interned_string, construction_task> todo_list;
   // int work_task_count;
   std::map<std::string, std::shared_ptr<task_group>> todo_task_groups;
 
@@ -161,6 +242,9 @@ public:
   std::map<std::string, blueprint_command> blueprint_commands;
   std::function<void(std::shared_ptr<task_group> group)> task_complete_handler;
 
+  // Returns the timestamp of a source file. Hosts that track file changes can supply cached values, otherwise the file system is queried.
+  std::function<fs::file_time_type(std::string_view path)> leaf_timestamp_handler;
+
   // SLC specific
   nlohmann::json template_contributions;
   std::unordered_set<std::string> slc_required;
@@ -168,10 +252,11 @@ public:
   std::map<std::string, const nlohmann::json> slc_recommended;
   std::multimap<std::string, std::string> instances;
   std::multimap<std::string, const std::shared_ptr<yakka::component>> slc_overrides;
+  slc_project slc_resolver;
   bool is_disqualified_by_unless(const nlohmann::json &node);
   bool condition_is_fulfilled(const nlohmann::json &node);
   void process_slc_rules();
-  void create_config_file(const std::shared_ptr<yakka::component> component, const nlohmann::json &config, const std::string &prefix, std::string instance_name);
+  std::string create_config_file(const std::shared_ptr<yakka::component> component, const nlohmann::json &config, const std::string &prefix, std::string instance_name, inja::Environment &inja_env, nlohmann::json &output);
 
 private:
   void init_project();
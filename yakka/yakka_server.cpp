@@ -0,0 +1,670 @@
+#include "yakka_server.hpp"
+#include "file_cache.hpp"
+#include "utilities.hpp"
+#include "cxxopts.hpp"
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/base_sink.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace yakka {
+#if defined(__linux__)
+static std::atomic<bool> stop_requested = false;
+
+// A client that hasn't sent its whole request by then is dropped so it can't stall the server
+static constexpr std::chrono::milliseconds request_timeout{ 5000 };
+
+static void handle_stop_signal(int)
+{
+  stop_requested = true;
+}
+
+static bool send_all(int fd, std::string_view data)
+{
+  while (!data.empty()) {
+    const auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent <= 0)
+      return false;
+    data.remove_prefix(sent);
+  }
+  return true;
+}
+
+// Output is sent to the client as "o <line>" records. The last record is "r <exit code>".
+static void send_output(int fd, std::string_view text)
+{
+  std::string records;
+  while (!text.empty()) {
+    const auto end = text.find('\n');
+    auto line      = text.substr(0, end);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    records.append("o ").append(line).append("\n");
+    if (end == std::string_view::npos)
+      break;
+    text.remove_prefix(end + 1);
+  }
+  send_all(fd, records);
+}
+
+class client_sink : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  explicit client_sink(int fd) : fd(fd)
+  {
+  }
+
+protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override
+  {
+    spdlog::memory_buf_t formatted;
+    formatter_->format(msg, formatted);
+    send_output(fd, std::string_view(formatted.data(), formatted.size()));
+  }
+  void flush_() override
+  {
+  }
+
+private:
+  int fd;
+};
+
+static std::string absolute_path(const fs::path &path)
+{
+  std::error_code error;
+  return fs::absolute(path, error).lexically_normal().generic_string();
+}
+
+server::server(yakka::workspace &workspace) : workspace(workspace)
+{
+  watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch_fd < 0)
+    spdlog::error("Cannot watch for file changes: {}", std::strerror(errno));
+
+  // Any file may be edited while the server holds its contents
+  get_file_cache().disable_mapping();
+}
+
+server::~server()
+{
+  if (watch_fd >= 0)
+    ::close(watch_fd);
+}
+
+int server::run()
+{
+  fs::create_directories(fs::path(server_socket_path).parent_path());
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, server_socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  // A socket left behind by a server that did not exit cleanly would block the bind
+  ::unlink(server_socket_path.c_str());
+  const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 8) != 0) {
+    spdlog::error("Cannot listen on {}: {}", server_socket_path, std::strerror(errno));
+    if (listen_fd >= 0)
+      ::close(listen_fd);
+    return -1;
+  }
+
+  std::signal(SIGINT, handle_stop_signal);
+  std::signal(SIGTERM, handle_stop_signal);
+  std::cout << "Serving " << fs::current_path().generic_string() << " on " << server_socket_path << ". Press Ctrl+C to stop.\n";
+
+  auto console = spdlog::get("console");
+  while (!stop_requested) {
+    pollfd listen_poll = { listen_fd, POLLIN, 0 };
+    if (::poll(&listen_poll, 1, 500) <= 0)
+      continue;
+
+    const int client_fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client_fd < 0)
+      continue;
+
+    // The request is a single line of JSON
+    std::string request;
+    char buffer[4096];
+    bool timed_out      = false;
+    const auto deadline = std::chrono::steady_clock::now() + request_timeout;
+    while (request.find('\n') == std::string::npos) {
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      pollfd client_poll   = { client_fd, POLLIN, 0 };
+      if (remaining <= 0 || ::poll(&client_poll, 1, static_cast<int>(remaining)) <= 0) {
+        timed_out = true;
+        break;
+      }
+      const auto received = ::recv(client_fd, buffer, sizeof(buffer), 0);
+      if (received <= 0)
+        break;
+      request.append(buffer, received);
+    }
+    if (timed_out) {
+      spdlog::warn("Dropping a client that sent no request within {}ms", request_timeout.count());
+      ::close(client_fd);
+      continue;
+    }
+
+    std::vector<std::string> arguments;
+    try {
+      arguments = nlohmann::json::parse(request.substr(0, request.find('\n')))["arguments"].get<std::vector<std::string>>();
+    } catch (std::exception &e) {
+      spdlog::error("Invalid request: {}", e.what());
+      send_all(client_fd, "r -1\n");
+      ::close(client_fd);
+      continue;
+    }
+
+    // Stream the console output and any warnings or errors to the client for the duration of the build
+    auto output_sink = std::make_shared<client_sink>(client_fd);
+    output_sink->set_pattern("%v");
+    auto error_sink = std::make_shared<client_sink>(client_fd);
+    error_sink->set_level(spdlog::level::warn);
+    error_sink->set_pattern("[%l]: %v");
+    if (console)
+      console->sinks().push_back(output_sink);
+    spdlog::default_logger()->sinks().push_back(error_sink);
+
+    int result = -1;
+    try {
+      result = build(arguments);
+    } catch (std::exception &e) {
+      spdlog::error("Build failed: {}", e.what());
+      project.reset();
+    }
+
+    if (console)
+      std::erase(console->sinks(), output_sink);
+    std::erase(spdlog::default_logger()->sinks(), error_sink);
+
+    send_all(client_fd, "r " + std::to_string(result) + "\n");
+    ::close(client_fd);
+  }
+
+  ::close(listen_fd);
+  ::unlink(server_socket_path.c_str());
+  return 0;
+}
+
+int server::build(const std::vector<std::string> &arguments)
+{
+  const auto start_time = std::chrono::steady_clock::now();
+
+  auto options = parse_options(arguments);
+  if (!options)
+    return -1;
+
+  apply_changes();
+  if (project && watch_needed)
+    watch_project();
+  watch_needed = false;
+
+  // Changes in a directory that couldn't be watched are missed, so nothing from a previous build is trusted
+  if (watch_failed) {
+    resolve_needed = true;
+    std::lock_guard<std::mutex> lock(timestamp_mutex);
+    timestamps.clear();
+  }
+
+  if (!project || resolve_needed || arguments != project_arguments) {
+    if (rescan_needed) {
+      spdlog::info("Rescanning workspace for components");
+      workspace.local_database.clear();
+      workspace.local_database.scan_for_components();
+      workspace.local_database.save();
+      rescan_needed = false;
+    }
+
+    project.reset();
+    project_arguments.clear();
+    if (!resolve(options.value())) {
+      project.reset();
+      return -1;
+    }
+    project_arguments      = arguments;
+    resolve_needed         = false;
+    previous_summary_valid = false;
+    graph_stale            = true;
+    stale_targets.clear();
+  }
+
+  if (graph_stale) {
+    // Drop the targets whose dependency files have changed so they are matched again
+    for (const auto &t: stale_targets)
+      project->target_database.targets.erase(intern(t));
+    stale_targets.clear();
+
+    // The graph stays stale so the problems are reported again by the next build
+    if (!generate_tasks())
+      return -1;
+    watch_project();
+    graph_stale = false;
+  } else {
+    project->reset_tasks();
+  }
+
+  executor.run(project->taskflow).wait();
+
+  // The build may have created directories that couldn't be watched before
+  if (!unwatched_directories.empty())
+    watch_project();
+
+  // The summary of the first successful build becomes the baseline for data dependencies
+  if (!previous_summary_valid && !project->abort_build) {
+    project->previous_summary = project->project_summary;
+    previous_summary_valid    = true;
+  }
+
+  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+  if (auto console = spdlog::get("console"))
+    console->info("Complete in {} milliseconds", duration);
+
+  return project->abort_build ? -1 : 0;
+}
+
+std::optional<server::build_options> server::parse_options(const std::vector<std::string> &arguments)
+{
+  cxxopts::Options parser("yakka", "");
+  parser.allow_unrecognised_options();
+  // clang-format off
+  parser.add_options()("r,refresh", "", cxxopts::value<bool>()->default_value("false"))
+                      ("n,no-eval", "", cxxopts::value<bool>()->default_value("false"))
+                      ("i,ignore-eval", "", cxxopts::value<bool>()->default_value("false"))
+                      ("o,no-output", "", cxxopts::value<bool>()->default_value("false"))
+                      ("f,fetch", "", cxxopts::value<bool>()->default_value("false"))
+                      ("p,project-name", "", cxxopts::value<std::string>()->default_value(""))
+                      ("w,with", "", cxxopts::value<std::vector<std::string>>())
+                      ("d,data", "", cxxopts::value<std::string>())
+                      ("no-slcc", "", cxxopts::value<bool>()->default_value("false"))
+                      ("no-yakka", "", cxxopts::value<bool>()->default_value("false"))
+                      ("stats", "", cxxopts::value<std::string>()->default_value("")->implicit_value("text"))
+                      ("action", "", cxxopts::value<std::string>());
+  // clang-format on
+  parser.parse_positional({ "action" });
+
+  std::vector<const char *> argv = { "yakka" };
+  for (const auto &a: arguments)
+    argv.push_back(a.c_str());
+  auto result = parser.parse(static_cast<int>(argv.size()), argv.data());
+
+  if (!result.count("action") || !result["action"].as<std::string>().ends_with('!')) {
+    spdlog::error("The server only runs commands (commands end with !)");
+    return {};
+  }
+  if (result["fetch"].as<bool>() || result["no-eval"].as<bool>() || result["refresh"].as<bool>())
+    spdlog::warn("--fetch, --no-eval and --refresh are not supported by the server and are ignored");
+
+  build_options options;
+  options.action = result["action"].as<std::string>();
+  options.action.pop_back();
+  options.commands.insert(options.action);
+
+  std::string feature_suffix;
+  for (const auto &s: result.unmatched()) {
+    if (s.empty())
+      continue;
+    if (s.front() == '+') {
+      feature_suffix += s;
+      options.features.push_back(s.substr(1));
+    } else if (s.back() == '!')
+      options.commands.insert(s.substr(0, s.size() - 1));
+    else {
+      options.components.push_back(s);
+      options.project_name += s + "-";
+    }
+  }
+
+  if (options.components.empty()) {
+    spdlog::error("No components identified");
+    return {};
+  }
+  options.project_name.pop_back();
+  options.project_name += feature_suffix;
+  if (!result["project-name"].as<std::string>().empty())
+    options.project_name = result["project-name"].as<std::string>();
+
+  if (result["with"].count() != 0)
+    options.with = result["with"].as<std::vector<std::string>>();
+  if (result["data"].count() != 0)
+    options.data = result["data"].as<std::string>();
+  options.ignore_eval = result["ignore-eval"].as<bool>();
+  options.no_slcc     = result["no-slcc"].as<bool>();
+  options.no_yakka    = result["no-yakka"].as<bool>();
+  return options;
+}
+
+/**
+ * @brief Evaluates the dependencies and choices of a new project and generates its summary
+ */
+bool server::evaluate(const build_options &options)
+{
+  if (project->evaluate_dependencies() == yakka::project::state::PROJECT_HAS_INVALID_COMPONENT)
+    return false;
+  if (!project->unknown_components.empty()) {
+    spdlog::info("Scanning workspace to find missing components");
+    workspace.local_database.scan_for_components();
+    workspace.shared_database.scan_for_components();
+    project->unprocessed_components.swap(project->unknown_components);
+    project->evaluate_dependencies();
+  }
+  if (!project->unknown_components.empty()) {
+    for (const auto &i: project->unknown_components)
+      spdlog::error("Missing component '{}'", i);
+    return false;
+  }
+
+  project->evaluate_choices();
+  if (!options.ignore_eval && (!project->incomplete_choices.empty() || !project->multiple_answer_choices.empty())) {
+    for (const auto &[component, choice]: project->incomplete_choices)
+      spdlog::error("Component '{}' has an incomplete choice '{}'", component, choice);
+    for (const auto &choice: project->multiple_answer_choices)
+      spdlog::error("Choice '{}' has more than one answer", choice);
+    return false;
+  }
+
+  if (!options.no_slcc)
+    project->process_slc_rules();
+
+  project->generate_project_summary();
+  project->save_summary();
+  const bool schema_valid = project->validate_schema();
+  if (project->current_state != yakka::project::state::PROJECT_VALID)
+    return false;
+
+  if (schema_valid)
+    project->save_resolution_snapshot();
+  return true;
+}
+
+/**
+ * @brief Resolves the project in the same way as a local build, up to and including the blueprints
+ */
+bool server::resolve(const build_options &options)
+{
+  project           = std::make_unique<yakka::project>(options.project_name, workspace);
+  project->commands = options.commands;
+  project->init_project(options.components, options.features);
+
+  if (options.no_yakka)
+    project->component_flags = yakka::component_database::flag::IGNORE_YAKKA;
+  if (options.no_slcc)
+    project->component_flags = yakka::component_database::flag::IGNORE_ALL_SLC;
+  else
+    for (const auto &f: options.with)
+      project->slc_required.insert(f);
+
+  if (!project->load_resolution_snapshot() && !evaluate(options))
+    return false;
+
+  if (!options.data.empty()) {
+    YAML::Node yaml_data     = YAML::Load("{" + options.data + "}");
+    nlohmann::json json_data = yaml_data.as<nlohmann::json>();
+    yakka::json_node_merge(project->project_summary["data"], json_data);
+    project->aggregates.clear();
+  }
+
+  project->process_blueprints();
+  if (!project->add_missing_blueprints())
+    return false;
+  project->load_common_commands();
+
+  // Only the timestamps of sources in watched directories are cached, as a change to any other source would not be seen
+  project->leaf_timestamp_handler = [this](std::string_view path) {
+    const std::string name(path);
+    if (!watched_sources.contains(name))
+      return timed_last_write_time(name);
+    {
+      std::lock_guard<std::mutex> lock(timestamp_mutex);
+      if (auto i = timestamps.find(name); i != timestamps.end())
+        return i->second;
+    }
+    const auto timestamp = timed_last_write_time(name);
+    std::lock_guard<std::mutex> lock(timestamp_mutex);
+    timestamps.insert_or_assign(name, timestamp);
+    return timestamp;
+  };
+  return true;
+}
+
+/**
+ * @brief Fills the target database and creates the task graph. Targets already in the database are not matched again.
+ *        Returns false without creating tasks if a reached blueprint is malformed.
+ */
+bool server::generate_tasks()
+{
+  project->clear_tasks();
+  project->generate_target_database();
+  if (!project->compile_blueprints())
+    return false;
+
+  project->todo_task_groups["Processing"] = std::make_shared<yakka::task_group>("Processing");
+  auto finish                             = project->taskflow.emplace([]() {});
+  for (const auto &c: project->commands)
+    project->create_tasks(c, finish);
+  return true;
+}
+
+/**
+ * @brief Watches a directory. Returns false if it doesn't exist or can't be watched.
+ *        Any failure other than the directory not existing, such as reaching the inotify watch limit, sets watch_failed.
+ */
+bool server::watch_directory(const fs::path &directory)
+{
+  if (watched_directory_names.contains(directory.generic_string()))
+    return true;
+
+  const int wd = inotify_add_watch(watch_fd, directory.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+  if (wd < 0) {
+    if (errno != ENOENT) {
+      spdlog::warn("Cannot watch {}: {}", directory.generic_string(), std::strerror(errno));
+      watch_failed = true;
+    }
+    return false;
+  }
+  watched_directories[wd] = directory;
+  watched_directory_names.insert(directory.generic_string());
+  return true;
+}
+
+/**
+ * @brief Watches the directory of a file. A directory that doesn't exist yet, such as a build output directory, is retried by
+ *        watch_project() and its nearest existing parent is watched so its creation is seen.
+ * @return True if the directory didn't exist when it was last watched, so changes to the file may have been missed
+ */
+bool server::watch(const std::string &path)
+{
+  const auto directory = fs::path(path).parent_path();
+  if (watch_fd < 0) {
+    watch_failed = true;
+    return false;
+  }
+
+  if (watch_directory(directory))
+    return unwatched_directories.erase(directory.generic_string()) != 0;
+
+  unwatched_directories.insert(directory.generic_string());
+  for (auto parent = directory.parent_path(); !parent.empty() && parent != parent.parent_path(); parent = parent.parent_path())
+    if (watch_directory(parent))
+      break;
+  return false;
+}
+
+/**
+ * @brief Watches the directories of the component files, the sources and the generated dependency files of the current project
+ */
+void server::watch_project()
+{
+  component_files.clear();
+  source_files.clear();
+  watched_sources.clear();
+  dependency_file_targets.clear();
+  watch_failed = false;
+
+  for (const auto &c: project->components) {
+    const auto path = absolute_path(c->file_path);
+    component_files.insert(path);
+    watch(path);
+  }
+
+  for (const auto &[name, todo]: project->todo_list) {
+    if (todo.match || name.front() == yakka::data_dependency_identifier)
+      continue;
+    const auto path = absolute_path(name.view());
+    source_files.try_emplace(path, name.str());
+    watch(path);
+    if (watched_directory_names.contains(fs::path(path).parent_path().generic_string()))
+      watched_sources.insert(name.str());
+  }
+
+  // A dependency file written while its directory wasn't watched is read again by matching its target
+  for (const auto &[target, match]: project->target_database.targets)
+    for (const auto &f: match->dependency_files) {
+      const auto path = absolute_path(f);
+      dependency_file_targets[path].push_back(target.str());
+      if (watch(path) && fs::exists(path)) {
+        stale_targets.insert(target.str());
+        graph_stale = true;
+      }
+    }
+}
+
+/**
+ * @brief Reads the pending file change events and records what must be regenerated
+ */
+void server::apply_changes()
+{
+  if (watch_fd < 0)
+    return;
+
+  alignas(inotify_event) char buffer[16384];
+  while (true) {
+    const auto length = ::read(watch_fd, buffer, sizeof(buffer));
+    if (length <= 0)
+      break;
+
+    for (auto *p = buffer; p < buffer + length;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(p);
+      p += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost so nothing cached can be trusted
+        resolve_needed = true;
+        std::lock_guard<std::mutex> lock(timestamp_mutex);
+        timestamps.clear();
+        continue;
+      }
+
+      const auto directory = watched_directories.find(event->wd);
+      if (directory == watched_directories.end() || event->len == 0)
+        continue;
+
+      // A new directory may be one that couldn't be watched yet
+      if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && !unwatched_directories.empty())
+        watch_needed = true;
+
+      const auto file       = directory->second / event->name;
+      const auto path       = file.generic_string();
+      const bool structural = event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+
+      if (component_files.contains(path))
+        resolve_needed = true;
+      else if (structural) {
+        const auto extension = file.extension();
+        if (extension == ".yakka" || extension == ".slcc" || extension == ".slce" || extension == ".slcp") {
+          resolve_needed = true;
+          rescan_needed  = true;
+        }
+      }
+
+      if (auto source = source_files.find(path); source != source_files.end()) {
+        std::lock_guard<std::mutex> lock(timestamp_mutex);
+        timestamps.erase(source->second);
+        if (structural)
+          graph_stale = true;
+      }
+
+      if (auto targets = dependency_file_targets.find(path); targets != dependency_file_targets.end()) {
+        stale_targets.insert(targets->second.begin(), targets->second.end());
+        graph_stale = true;
+      }
+    }
+  }
+}
+
+std::optional<int> run_with_server(const std::vector<std::string> &arguments)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, server_socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return {};
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    ::close(fd);
+    return {};
+  }
+
+  nlohmann::json request;
+  request["arguments"] = arguments;
+  if (!send_all(fd, request.dump() + "\n")) {
+    ::close(fd);
+    return {};
+  }
+
+  std::string pending;
+  char buffer[4096];
+  ssize_t received;
+  while ((received = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    pending.append(buffer, received);
+    size_t end;
+    while ((end = pending.find('\n')) != std::string::npos) {
+      const std::string_view record(pending.data(), end);
+      if (record.starts_with("o ")) {
+        std::cout << record.substr(2) << '\n';
+      } else if (record.starts_with("r ")) {
+        std::cout << std::flush;
+        ::close(fd);
+        return std::stoi(std::string(record.substr(2)));
+      }
+      pending.erase(0, end + 1);
+    }
+    std::cout << std::flush;
+  }
+
+  ::close(fd);
+  std::cerr << "Lost connection to the yakka server\n";
+  return -1;
+}
+
+#else
+server::server(yakka::workspace &workspace) : workspace(workspace)
+{
+}
+
+server::~server()
+{
+}
+
+int server::run()
+{
+  spdlog::error("The yakka server is only supported on Linux");
+  return -1;
+}
+
+std::optional<int> run_with_server(const std::vector<std::string> &arguments)
+{
+  return {};
+}
+#endif
+} // namespace yakka
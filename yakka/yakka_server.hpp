@@ -0,0 +1,93 @@
+#pragma once
+
+#include "yakka.hpp"
+#include "yakka_workspace.hpp"
+#include "yakka_project.hpp"
+#include "taskflow.hpp"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace yakka {
+const std::string server_socket_path = ".yakka/server.sock";
+
+/**
+ * @brief Long running build server for a workspace, started with 'yakka serve'. Requires Linux.
+ *        The resolved project, target database, task graph and source timestamps are kept between builds. Component files, sources and
+ *        generated dependency files are watched with inotify and a change only invalidates what depends on it:
+ *        - A changed component file re-resolves the project. New or removed component files also rescan the workspace.
+ *        - A changed source drops its cached timestamp. A created or removed source recreates the task graph.
+ *        - A changed dependency file re-matches the targets that read it and recreates the task graph.
+ *        If a directory can't be watched, for example at the inotify watch limit, each build resolves the project again and reads every timestamp.
+ *        Requests arrive on a unix socket, one at a time, and the build output is streamed back to the client.
+ *        A client that doesn't send its request within a few seconds is dropped.
+ */
+class server {
+public:
+  server(yakka::workspace &workspace);
+  ~server();
+
+  // Serves requests until interrupted. Returns the exit code.
+  int run();
+
+private:
+  struct build_options {
+    std::string action;
+    std::vector<std::string> components;
+    std::vector<std::string> features;
+    std::unordered_set<std::string> commands;
+    std::vector<std::string> with;
+    std::string project_name;
+    std::string data;
+    bool ignore_eval;
+    bool no_slcc;
+    bool no_yakka;
+  };
+
+  int build(const std::vector<std::string> &arguments);
+  std::optional<build_options> parse_options(const std::vector<std::string> &arguments);
+  bool resolve(const build_options &options);
+  bool evaluate(const build_options &options);
+  bool generate_tasks();
+  bool watch_directory(const std::filesystem::path &directory);
+  bool watch(const std::string &path);
+  void watch_project();
+  void apply_changes();
+
+  yakka::workspace &workspace;
+  std::unique_ptr<yakka::project> project;
+  std::vector<std::string> project_arguments;
+  bool previous_summary_valid = false;
+
+  // inotify state. Files are keyed by absolute path
+  int watch_fd = -1;
+  std::unordered_map<int, std::filesystem::path> watched_directories;
+  std::unordered_set<std::string> watched_directory_names;
+  std::unordered_set<std::string> unwatched_directories; // Directories of watched files that didn't exist
+  std::unordered_set<std::string> watched_sources;       // Target names of the sources whose directory is watched
+  std::unordered_set<std::string> component_files;
+  std::unordered_map<std::string, std::string> source_files;                         // Absolute path to target name
+  std::unordered_map<std::string, std::vector<std::string>> dependency_file_targets; // Absolute path to the targets that read it
+  std::unordered_set<std::string> stale_targets;
+  bool resolve_needed = false;
+  bool rescan_needed  = false;
+  bool graph_stale    = true;
+  bool watch_needed   = false;
+  bool watch_failed   = false; // A directory couldn't be watched for a reason other than not existing
+
+  // Cached timestamps of source files, keyed by target name
+  std::mutex timestamp_mutex;
+  std::unordered_map<std::string, std::filesystem::file_time_type> timestamps;
+
+  tf::Executor executor;
+};
+
+// Sends a command line to the server of the workspace in the current directory and prints the streamed output.
+// Returns the exit code of the build, or nothing if there is no server running.
+std::optional<int> run_with_server(const std::vector<std::string> &arguments);
+} // namespace yakka
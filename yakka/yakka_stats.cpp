@@ -0,0 +1,123 @@
+#include "yakka_stats.hpp"
+#include "nlohmann/json.hpp"
+#include <map>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#if defined(_WIN64) || defined(_WIN32) || defined(__CYGWIN__)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <string>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace yakka {
+struct stat_phase {
+  std::string name;
+  uint64_t nanoseconds;
+  uint64_t peak_rss_kib;
+};
+
+static std::mutex stat_counters_mutex;
+static std::map<std::string, stat_counter> stat_counters;
+static std::vector<stat_phase> stat_phases;
+static auto stat_phase_start = std::chrono::steady_clock::now();
+
+// On Linux this is the peak since the previous phase was recorded. Elsewhere the peak can't be reset and is the peak for the whole process so far.
+static uint64_t peak_rss_kib()
+{
+#if defined(_WIN64) || defined(_WIN32) || defined(__CYGWIN__)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) == 0)
+    return 0;
+  return counters.PeakWorkingSetSize / 1024;
+#elif defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+    if (line.starts_with("VmHWM:"))
+      return std::stoull(line.substr(6));
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  // macOS reports bytes
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static void reset_peak_rss()
+{
+#if defined(__linux__)
+  // Writing 5 resets VmHWM to the current RSS
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+stat_counter &get_stat_counter(const std::string &name)
+{
+  std::lock_guard<std::mutex> lock(stat_counters_mutex);
+  return stat_counters[name];
+}
+
+void record_stat_phase(const std::string &name)
+{
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(stat_counters_mutex);
+  stat_phases.push_back({ name, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - stat_phase_start).count()), peak_rss_kib() });
+  reset_peak_rss();
+  stat_phase_start = now;
+}
+
+void print_stats(bool json)
+{
+  std::lock_guard<std::mutex> lock(stat_counters_mutex);
+  if (json) {
+    nlohmann::json output;
+    output["counters"] = nlohmann::json::object();
+    for (const auto &[name, counter]: stat_counters) {
+      const auto count = counter.count.load(std::memory_order_relaxed);
+      if (count == 0)
+        continue;
+      auto &entry    = output["counters"][name];
+      entry["count"] = count;
+      entry["ms"]    = counter.nanoseconds.load(std::memory_order_relaxed) / 1e6;
+      if (const auto amount = counter.amount.load(std::memory_order_relaxed); amount != 0)
+        entry["amount"] = amount;
+    }
+    output["phases"] = nlohmann::json::array();
+    for (const auto &p: stat_phases)
+      output["phases"].push_back({ { "name", p.name }, { "ms", p.nanoseconds / 1e6 }, { "peak_rss_kib", p.peak_rss_kib } });
+    std::cout << output.dump(2) << "\n";
+    return;
+  }
+
+  std::cout << std::left << std::setw(32) << "Operation" << std::right << std::setw(12) << "Calls" << std::setw(14) << "Time (ms)" << std::setw(16) << "Amount" << "\n";
+  for (const auto &[name, counter]: stat_counters) {
+    const auto count = counter.count.load(std::memory_order_relaxed);
+    if (count == 0)
+      continue;
+    std::cout << std::left << std::setw(32) << name << std::right << std::setw(12) << count << std::setw(14) << std::fixed << std::setprecision(3)
+              << counter.nanoseconds.load(std::memory_order_relaxed) / 1e6;
+    if (const auto amount = counter.amount.load(std::memory_order_relaxed); amount != 0)
+      std::cout << std::setw(16) << amount;
+    std::cout << "\n";
+  }
+
+  if (stat_phases.empty())
+    return;
+  std::cout << "\n" << std::left << std::setw(32) << "Phase" << std::right << std::setw(12) << "Time (ms)" << std::setw(18) << "Peak RSS (KiB)" << "\n";
+  for (const auto &p: stat_phases)
+    std::cout << std::left << std::setw(32) << p.name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << p.nanoseconds / 1e6 << std::setw(18) << p.peak_rss_kib << "\n";
+}
+} // namespace yakka
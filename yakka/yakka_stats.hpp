@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace yakka {
+// Call count, accumulated time and accumulated amount (e.g. bytes) for an instrumented operation.
+// Updated with relaxed atomics so it is cheap enough to leave enabled.
+struct stat_counter {
+  std::atomic<uint64_t> count       = 0;
+  std::atomic<uint64_t> nanoseconds = 0;
+  std::atomic<uint64_t> amount      = 0;
+
+  void add(uint64_t elapsed_nanoseconds)
+  {
+    count.fetch_add(1, std::memory_order_relaxed);
+    nanoseconds.fetch_add(elapsed_nanoseconds, std::memory_order_relaxed);
+  }
+
+  void increment()
+  {
+    count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void add_amount(uint64_t value)
+  {
+    count.fetch_add(1, std::memory_order_relaxed);
+    amount.fetch_add(value, std::memory_order_relaxed);
+  }
+};
+
+// Returns the counter for a name. The reference remains valid for the lifetime of the program.
+stat_counter &get_stat_counter(const std::string &name);
+
+// Marks the end of a phase of the run, recording the time since the previous phase and the peak resident set size during it (the peak so far on platforms other than Linux)
+void record_stat_phase(const std::string &name);
+
+// Prints all counters that have been used, sorted by name, followed by the recorded phases. Prints JSON if json is true.
+void print_stats(bool json = false);
+
+// Adds the lifetime of the object to a counter
+class scoped_stat_timer {
+public:
+  scoped_stat_timer(stat_counter &counter) : counter(counter), start(std::chrono::steady_clock::now())
+  {
+  }
+  ~scoped_stat_timer()
+  {
+    counter.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+
+private:
+  stat_counter &counter;
+  std::chrono::steady_clock::time_point start;
+};
+} // namespace yakka
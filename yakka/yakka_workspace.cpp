@@ -3,12 +3,18 @@
  */
 #include "yakka.hpp"
 #include "yakka_workspace.hpp"
+#include "yakka_component.hpp"
 #include "component_database.hpp"
 #include "utilities.hpp"
+#include "yakka_stats.hpp"
 #include "spdlog/sinks/basic_file_sink.h"
 #include <filesystem>
 #include <fstream>
 #include <regex>
+#include <mutex>
+#include <map>
+#include <algorithm>
+#include <cctype>
 
 namespace fs = std::filesystem;
 
@@ -102,6 +108,8 @@ std::optional<YAML::Node> workspace::find_registry_component(const std::string &
 
 std::optional<std::pair<fs::path, fs::path>> workspace::find_component(const std::string component_dotname, component_database::flag flags)
 {
+  static auto &stats = get_stat_counter("workspace find_component");
+  scoped_stat_timer timer(stats);
   bool try_update_the_database   = false;
   const std::string component_id = yakka::component_dotname_to_id(component_dotname);
 
@@ -138,6 +146,8 @@ std::optional<std::pair<fs::path, fs::path>> workspace::find_component(const std
 
 std::optional<nlohmann::json> workspace::find_feature(const std::string feature) const
 {
+  static auto &stats = get_stat_counter("workspace find_feature");
+  scoped_stat_timer timer(stats);
   nlohmann::json node;
   node = local_database.get_feature_provider(feature);
   if (!node.is_null())
@@ -156,6 +166,8 @@ std::optional<nlohmann::json> workspace::find_feature(const std::string feature)
 
 std::optional<nlohmann::json> workspace::find_blueprint(const std::string blueprint) const
 {
+  static auto &stats = get_stat_counter("workspace find_blueprint");
+  scoped_stat_timer timer(stats);
   nlohmann::json node;
   node = local_database.get_blueprint_provider(blueprint);
   if (!node.is_null())
@@ -216,18 +228,67 @@ void workspace::load_config_file(const fs::path config_file_path)
   }
 }
 
-std::future<fs::path> workspace::fetch_component(const std::string &name, YAML::Node node, std::function<void(std::string, size_t)> progress_handler)
+/**
+ * @brief Starts fetching a component in the background.
+ *        The optional completion handler is called from the fetching thread with the checkout location, or an empty path if the fetch failed.
+ */
+std::future<fs::path> workspace::fetch_component(const std::string &name, YAML::Node node, std::function<void(std::string, size_t)> progress_handler, std::function<void(const fs::path &)> completion_handler)
 {
   std::string url                           = try_render(inja_environment, node["packages"]["default"]["url"].as<std::string>(), configuration_json);
   std::string branch                        = try_render(inja_environment, node["packages"]["default"]["branch"].as<std::string>(), configuration_json);
   const bool shared_components_write_access = (fs::status(shared_components_path).permissions() & fs::perms::owner_write) != fs::perms::none;
   fs::path git_location                     = (node["type"] && node["type"].as<std::string>() == "tool" && shared_components_write_access) ? shared_components_path / "repos" : workspace_path / ".yakka/repos";
   fs::path checkout_location                = (node["type"] && node["type"].as<std::string>() == "tool" && shared_components_write_access) ? shared_components_path / "repos" / name : workspace_path / "components" / name;
+
+  fetch_options options;
+  if (shared_components_write_access && !(configuration["git_cache"].IsDefined() && !configuration["git_cache"].as<bool>()))
+    options.cache_location = shared_components_path / "git-cache";
+  options.partial_clone = configuration["partial_clone"].IsDefined() && configuration["partial_clone"].as<bool>();
+  if (node["packages"]["default"]["subdirectory"].IsDefined())
+    options.sparse_path = node["packages"]["default"]["subdirectory"].as<std::string>();
+
   return std::async(std::launch::async, [=]() -> fs::path {
-    return do_fetch_component(name, url, branch, git_location, checkout_location, progress_handler);
+    fs::path path;
+    try {
+      path = do_fetch_component(name, url, branch, git_location, checkout_location, options, progress_handler);
+    } catch (const std::exception &e) {
+      spdlog::error("Error fetching {}: {}", name, e.what());
+    } catch (...) {
+      spdlog::error("Error fetching {}", name);
+    }
+    if (completion_handler)
+      completion_handler(path);
+    return path;
   });
 }
 
+/**
+ * @brief Returns the components required by the .yakka files of a freshly fetched component so they can be fetched without waiting for a full evaluation.
+ *        This does not touch the workspace so it is safe to call from a fetching thread.
+ */
+std::vector<std::string> workspace::find_required_components(const fs::path &component_path)
+{
+  std::vector<std::string> required;
+  std::error_code error;
+  for (auto p = fs::recursive_directory_iterator(component_path, error); !error && p != fs::recursive_directory_iterator(); p.increment(error)) {
+    if (p->is_directory() && p->path().filename() == ".git") {
+      p.disable_recursion_pending();
+      continue;
+    }
+    if (p->path().extension() != yakka_component_extension)
+      continue;
+
+    yakka::component component;
+    if (component.parse_file(p->path()) != yakka_status::SUCCESS)
+      continue;
+
+    if (component.json.contains("/requires/components"_json_pointer))
+      for (const auto &r: component.json["requires"]["components"])
+        required.push_back(yakka::component_dotname_to_id(r.get<std::string>()));
+  }
+  return required;
+}
+
 #define GIT_STRING "git"
 yakka_status workspace::fetch_registry(const std::string &url)
 {
@@ -269,9 +330,66 @@ yakka_status workspace::update_component(const std::string &name)
 }
 
 using namespace std::string_literals;
-fs::path workspace::do_fetch_component(const std::string &name, const std::string url, const std::string branch, const fs::path git_location, const fs::path checkout_location, std::function<void(std::string, size_t)> progress_handler)
+
+/**
+ * @brief Returns the location of the shared bare mirror for a repository URL.
+ *        Partial mirrors are kept apart as a full clone can't borrow objects a partial mirror doesn't have.
+ */
+static fs::path git_cache_mirror(const fs::path &cache_location, const std::string &url, bool partial_clone)
 {
-  auto fetch_log = spdlog::basic_logger_mt("fetchlog-" + name, "yakka-fetch-" + name + ".log");
+  std::string mirror_name = url.ends_with(".git") ? url.substr(0, url.size() - 4) : url;
+  std::replace_if(mirror_name.begin(), mirror_name.end(), [](char c) { return !std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '.'; }, '_');
+  return cache_location / (mirror_name + (partial_clone ? ".partial.git" : ".git"));
+}
+
+/**
+ * @brief Creates or incrementally refreshes the shared bare mirror for a repository URL.
+ *        Mirrors are shared between fetches so access to each one is serialized.
+ *        Clones borrow objects from the mirror through objects/info/alternates so it is never pruned or garbage collected.
+ *        The mirror must not be removed, pruned or garbage collected by hand either, as the clones that borrow from it would lose objects.
+ * @return The mirror location or an empty path if the mirror could not be used
+ */
+static fs::path update_git_cache(const fs::path &cache_location, const std::string &url, bool partial_clone, std::function<void(std::string &)> output_handler)
+{
+  static std::mutex cache_mutex;
+  static std::map<fs::path, std::mutex> mirror_mutexes;
+
+  const auto mirror = git_cache_mirror(cache_location, url, partial_clone);
+  std::unique_lock<std::mutex> cache_lock(cache_mutex);
+  auto &mirror_mutex = mirror_mutexes[mirror];
+  cache_lock.unlock();
+  std::lock_guard<std::mutex> mirror_lock(mirror_mutex);
+
+  int retcode;
+  if (fs::exists(mirror / "HEAD")) {
+    spdlog::info("Refreshing git cache {}", mirror.string());
+    retcode = yakka::exec(GIT_STRING, "--git-dir \"" + mirror.string() + "\" -c gc.auto=0 fetch --progress origin", output_handler);
+  } else {
+    spdlog::info("Creating git cache {}", mirror.string());
+    std::error_code error;
+    fs::create_directories(cache_location, error);
+    retcode = yakka::exec(GIT_STRING, "clone --mirror --config gc.auto=0 --progress "s + (partial_clone ? "--filter=blob:none " : "") + url + " \"" + mirror.string() + "\"", output_handler);
+  }
+
+  if (retcode != 0) {
+    spdlog::warn("Not using git cache for {}", url);
+    return {};
+  }
+  return mirror;
+}
+
+fs::path workspace::do_fetch_component(const std::string &name,
+                                       const std::string url,
+                                       const std::string branch,
+                                       const fs::path git_location,
+                                       const fs::path checkout_location,
+                                       const fetch_options options,
+                                       std::function<void(std::string, size_t)> progress_handler)
+{
+  // A component fetched again in the same process, such as by the server, reuses its log
+  auto fetch_log = spdlog::get("fetchlog-" + name);
+  if (!fetch_log)
+    fetch_log = spdlog::basic_logger_mt("fetchlog-" + name, "yakka-fetch-" + name + ".log");
   fetch_log->flush_on(spdlog::level::info);
 
   enum {
@@ -286,7 +404,6 @@ fs::path workspace::do_fetch_component(const std::string &name, const std::strin
   int retcode;
 
   try {
-    // If the clone location already exists then something probably went wrong so delete it and it will try again
     if (!fs::exists(git_location)) {
       spdlog::info("Creating {}", git_location.string());
       fs::create_directories(git_location);
@@ -296,11 +413,6 @@ fs::path workspace::do_fetch_component(const std::string &name, const std::strin
       spdlog::info("Creating {}", checkout_location.string());
       fs::create_directories(checkout_location);
     }
-
-    if (fs::exists(git_location / name)) {
-      spdlog::info("Removing {}", (git_location / name).string());
-      fs::remove_all(git_location / name);
-    }
   } catch (const std::exception &e) {
     std::cerr << e.what() << '\n';
     return {};
@@ -308,10 +420,7 @@ fs::path workspace::do_fetch_component(const std::string &name, const std::strin
 
   // Of the total time to fetch a Git repo, 10% is allocated to counting, 10% to compressing, and 80% to receiving.
   static const std::string phase_names[] = { "Counting", "Compressing", "Receiving", "Resolving", "Updating", "Fetch LFS" };
-  const std::string fetch_string         = "-C \"" + git_location.string() + "\" clone " + url + " " + name + " -b " + branch + " --progress --single-branch --no-checkout";
-
-  auto t1 = std::chrono::high_resolution_clock::now();
-  retcode = yakka::exec(GIT_STRING, fetch_string, [&](std::string &data) -> void {
+  auto fetch_progress                    = [&](std::string &data) -> void {
     fetch_log->info(data);
 
     std::smatch s;
@@ -336,15 +445,76 @@ fs::path workspace::do_fetch_component(const std::string &name, const std::strin
         progress_handler(phase_names[phase], progress);
       old_progress = progress;
     }
-  });
-  if (retcode < 0) {
-    return {};
+  };
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  // Bring the shared mirror up to date so the clone below only needs objects it doesn't have
+  fs::path mirror;
+  if (!options.cache_location.empty())
+    mirror = update_git_cache(options.cache_location, url, options.partial_clone, [&](std::string &data) {
+      fetch_log->info(data);
+    });
+
+  // Refresh an existing clone with an incremental fetch rather than cloning it again
+  const fs::path git_directory = git_location / name / ".git";
+  bool have_repository         = false;
+  if (fs::exists(git_directory / "HEAD")) {
+    retcode = yakka::exec(GIT_STRING, "--git-dir \"" + git_directory.string() + "\" fetch --progress origin " + branch, fetch_progress);
+    if (retcode == 0)
+      have_repository = true;
+    else {
+      spdlog::info("Removing {}", (git_location / name).string());
+      std::error_code error;
+      fs::remove_all(git_location / name, error);
+    }
+  } else if (fs::exists(git_location / name)) {
+    // If the clone location exists without a repository then something probably went wrong so delete it and it will try again
+    spdlog::info("Removing {}", (git_location / name).string());
+    std::error_code error;
+    fs::remove_all(git_location / name, error);
+  }
+
+  if (!have_repository) {
+    std::string fetch_string = "-C \"" + git_location.string() + "\" clone " + url + " " + name + " -b " + branch + " --progress --single-branch --no-checkout";
+    if (!mirror.empty())
+      fetch_string += " --reference-if-able \"" + mirror.string() + "\"";
+    if (options.partial_clone)
+      fetch_string += " --filter=blob:none";
+
+    retcode = yakka::exec(GIT_STRING, fetch_string, fetch_progress);
+    if (retcode != 0) {
+      return {};
+    }
   }
   auto t2       = std::chrono::high_resolution_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
-  spdlog::info("{}: cloned in {}ms", name, duration);
+  spdlog::info("{}: {} in {}ms", name, have_repository ? "fetched" : "cloned", duration);
+
+  // Restrict the checkout to the component subdirectory, or lift the restriction left by an earlier fetch that had one
+  const fs::path sparse_checkout_file = git_directory / "info" / "sparse-checkout";
+  if (!options.sparse_path.empty()) {
+    auto [config_output, config_result] = yakka::exec(GIT_STRING, "--git-dir \"" + git_directory.string() + "\" config core.sparseCheckout true");
+    fetch_log->info(config_output);
+    std::ofstream sparse_file(sparse_checkout_file);
+    sparse_file << "/" << options.sparse_path << "/\n";
+  } else if (fs::exists(sparse_checkout_file)) {
+    auto [config_output, config_result] = yakka::exec(GIT_STRING, "--git-dir \"" + git_directory.string() + "\" config core.sparseCheckout false");
+    fetch_log->info(config_output);
+    std::error_code error;
+    fs::remove(sparse_checkout_file, error);
+    // The index still marks the files outside the old subdirectory as skipped, so the checkout rebuilds it
+    fs::remove(git_directory / "index", error);
+  }
 
-  const std::string checkout_string = "--git-dir \""s + git_location.string() + "/" + name + "/.git\" --work-tree \"" + checkout_location.string() + "\" checkout " + branch + " --progress --force";
+  // A new clone checks out the branch or tag it was cloned with. A refreshed clone checks out what was fetched,
+  // moving the local branch if 'branch' names one and detaching if it names a tag
+  std::string checkout_target = branch;
+  if (have_repository) {
+    auto [ref_output, ref_result] = yakka::exec(GIT_STRING, "--git-dir \"" + git_directory.string() + "\" rev-parse --verify --quiet refs/heads/" + branch);
+    checkout_target               = (ref_result == 0) ? "-B " + branch + " FETCH_HEAD" : "--detach FETCH_HEAD";
+  }
+  const std::string checkout_string = "--git-dir \""s + git_directory.string() + "\" --work-tree \"" + checkout_location.string() + "\" checkout " + checkout_target + " --progress --force";
 
   // Checkout instance
   t1      = std::chrono::high_resolution_clock::now();
@@ -366,7 +536,7 @@ fs::path workspace::do_fetch_component(const std::string &name, const std::strin
       progress_handler(phase_names[phase], progress);
     }
   });
-  if (retcode < 0) {
+  if (retcode != 0) {
     return {};
   }
   t2       = std::chrono::high_resolution_clock::now();
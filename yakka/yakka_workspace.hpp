@@ -12,10 +12,17 @@
 namespace yakka {
 class workspace {
 public:
+  // Options controlling how a component repository is fetched
+  struct fetch_options {
+    fs::path cache_location;    // Directory of shared bare mirrors. Empty disables the cache. Clones depend on the mirrors, which must not be removed or pruned
+    bool partial_clone = false; // Clone with --filter=blob:none
+    std::string sparse_path;    // Only check out this subdirectory of the repository
+  };
+
   workspace();
   ~workspace();
   void init(fs::path workspace_path = ".");
-  std::future<fs::path> fetch_component(const std::string &name, YAML::Node node, std::function<void(std::string, size_t)> progress_handler);
+  std::future<fs::path> fetch_component(const std::string &name, YAML::Node node, std::function<void(std::string, size_t)> progress_handler, std::function<void(const fs::path &)> completion_handler = {});
   void load_component_registries();
   yakka_status add_component_registry(const std::string &url);
   std::optional<YAML::Node> find_registry_component(const std::string &name);
@@ -33,7 +40,9 @@ public:
                                                   const std::string branch,
                                                   const fs::path git_location,
                                                   const fs::path checkout_location,
+                                                  const fetch_options options,
                                                   std::function<void(std::string, size_t)> progress_handler);
+  static std::vector<std::string> find_required_components(const fs::path &component_path);
 
 public:
   std::shared_ptr<spdlog::logger> log;